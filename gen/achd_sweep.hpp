@@ -0,0 +1,754 @@
+#ifndef ACHD_SWEEP_HPP
+#define ACHD_SWEEP_HPP
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/rigidbodyinertia.hpp>
+
+#include "fk_cache.hpp"
+
+#define ACHD_SWEEP_MAX_JOINTS 7
+#define ACHD_SWEEP_MAX_CONSTRAINTS 6
+
+// added to the diagonal of a singular constraint space inertia
+#define ACHD_SWEEP_REGULARIZATION 1e-9
+
+// size template argument of a sweep or solve sized at run time
+#define ACHD_SWEEP_DYNAMIC 0
+
+/**
+ * Whole-cycle dynamics of one arm, computed in one outward and one inward
+ * sweep over its chain instead of by every solver on its own.
+ *
+ * transform_alpha, achd_solver, transform_wrench and achd_solver_fext each
+ * walk the same 7-joint chain. Here, update_achd_sweep walks it once per
+ * cycle, right after get_robot_data. It writes the poses of the links of the
+ * chain into the FK cache, in place of update_fk_cache, and computes
+ * everything the solvers need that only depends on the state of the arm:
+ * the joint twists, the Jacobian of the tip, the joint space inertia matrix
+ * and the bias torques. achd_sweep_solve and achd_sweep_wrench_torques then
+ * only solve the small dense systems of the constraints and wrenches of the
+ * cycle, without recursing over the chain again.
+ *
+ * All quantities are expressed in FK_CACHE_ROOT coordinates, with moments
+ * and twists w.r.t. its origin, so no transform is needed along the chain.
+ * Screws are stored linear part first, as the rest of the loop does.
+ *
+ * The problem is the one of the Vereshchagin solver behind achd_solver:
+ * joint accelerations qdd with M qdd + h = tau_ff + J^T A nu, such that the
+ * acceleration of the tip satisfies A^T (J qdd + Jd qd) = beta. The
+ * acceleration of the tip is its spatial acceleration at the tip point and
+ * includes the acceleration of the root, i.e. the root acceleration stands
+ * in for gravity.
+ */
+struct AchdSweep
+{
+  FkCache *cache;
+  int chain;         // index of the swept chain in the cache
+  int root_segment;  // index in the chain of the root link, the segments up to it are fixed
+  int first_link;    // cache ID of the first segment of the chain
+  int tip_link;      // cache ID of the tip, the last segment of the chain
+  const double *qd;  // joint velocities of the arm, ManipulatorState::q_dot
+  int nj;
+  int num_segments;
+
+  // per segment of the chain: joint index, -1 if fixed, and the inertia of
+  // the segment in its tip frame, about its center of mass
+  int joint[FK_CACHE_MAX_LINKS];
+  double mass[FK_CACHE_MAX_LINKS];
+  KDL::Vector cog[FK_CACHE_MAX_LINKS];
+  double inertia[FK_CACHE_MAX_LINKS][9];
+
+  // results of update_achd_sweep
+  double twists[ACHD_SWEEP_MAX_JOINTS][6];    // twist of every joint per unit velocity
+  double jacobian[ACHD_SWEEP_MAX_JOINTS][6];  // columns, the same twists at the tip point
+  double tip_bias[6];                         // acceleration of the tip at qdd = 0
+  double bias_torques[ACHD_SWEEP_MAX_JOINTS];  // Coriolis, centrifugal and root acceleration
+  double mass_factor[ACHD_SWEEP_MAX_JOINTS][ACHD_SWEEP_MAX_JOINTS];  // Cholesky factor of M
+
+  // scratch of the sweeps
+  double body_inertia[FK_CACHE_MAX_LINKS][6][6];
+  double body_force[FK_CACHE_MAX_LINKS][6];
+  double composite_twists[ACHD_SWEEP_MAX_JOINTS][6];
+
+  // external wrenches on the segments, collected by achd_sweep_add_wrench
+  double wrenches[FK_CACHE_MAX_LINKS][6];
+
+  // statistics
+  long sweeps;
+  long solves;
+  long singular_solves;  // constraint space inertia regularized
+};
+
+inline void achd_sweep_cross(const KDL::Vector &a, const double *b, double *out)
+{
+  out[0] = a.y() * b[2] - a.z() * b[1];
+  out[1] = a.z() * b[0] - a.x() * b[2];
+  out[2] = a.x() * b[1] - a.y() * b[0];
+}
+
+inline double achd_sweep_dot(const double *a, const double *b)
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] + a[4] * b[4] + a[5] * b[5];
+}
+
+/**
+ * Twist `twist` w.r.t. the origin re-referenced to `point`.
+ */
+inline void achd_sweep_ref_point(const double *twist, const KDL::Vector &point, double *out)
+{
+  double moment[3];
+  achd_sweep_cross(KDL::Vector(twist[3], twist[4], twist[5]), point.data, moment);
+  for (int i = 0; i < 3; i++)
+  {
+    out[i] = twist[i] + moment[i];
+    out[3 + i] = twist[3 + i];
+  }
+}
+
+/**
+ * In-place Cholesky factorization of the symmetric positive definite n x n
+ * matrix in the lower triangle of `a`. Pivots below `min_pivot` are raised by
+ * ACHD_SWEEP_REGULARIZATION.
+ *
+ * @return false if a pivot had to be raised
+ */
+template <int N>
+inline bool achd_sweep_cholesky(double (*a)[N], int n, double min_pivot)
+{
+  bool regular = true;
+  for (int j = 0; j < n; j++)
+  {
+    double pivot = a[j][j];
+    for (int k = 0; k < j; k++)
+    {
+      pivot -= a[j][k] * a[j][k];
+    }
+    if (pivot < min_pivot)
+    {
+      pivot += ACHD_SWEEP_REGULARIZATION;
+      regular = false;
+    }
+    a[j][j] = sqrt(pivot);
+
+    for (int i = j + 1; i < n; i++)
+    {
+      double sum = a[i][j];
+      for (int k = 0; k < j; k++)
+      {
+        sum -= a[i][k] * a[j][k];
+      }
+      a[i][j] = sum / a[j][j];
+    }
+  }
+  return regular;
+}
+
+/**
+ * Solves L L^T x = b in place of b, with L from achd_sweep_cholesky.
+ */
+template <int N>
+inline void achd_sweep_cholesky_solve(const double (*l)[N], int n, double *b)
+{
+  for (int i = 0; i < n; i++)
+  {
+    for (int k = 0; k < i; k++)
+    {
+      b[i] -= l[i][k] * b[k];
+    }
+    b[i] /= l[i][i];
+  }
+  for (int i = n - 1; i >= 0; i--)
+  {
+    for (int k = i + 1; k < n; k++)
+    {
+      b[i] -= l[k][i] * b[k];
+    }
+    b[i] /= l[i][i];
+  }
+}
+
+/**
+ * @param root_link first link of the arm, the joints up to it must be fixed
+ * @param tip_link tool frame of the arm, the last link of a chain of the cache
+ * @param qd joint velocities of the arm, must not be reallocated
+ */
+inline bool initialize_achd_sweep(AchdSweep *sweep, FkCache *cache, const std::string &root_link,
+                                  const std::string &tip_link, const double *qd)
+{
+  int root = fk_cache_link_id(cache, root_link);
+  int tip = fk_cache_link_id(cache, tip_link);
+
+  sweep->chain = -1;
+  for (int c = 0; c < cache->num_chains; c++)
+  {
+    const FkCacheChain *chain = &cache->chains[c];
+    if (tip == chain->first_link + (int)chain->chain.getNrOfSegments() - 1)
+    {
+      sweep->chain = c;
+    }
+  }
+  if (sweep->chain < 0)
+  {
+    printf("%s is not the tool frame of a chain of the FK cache\n", tip_link.c_str());
+    return false;
+  }
+
+  FkCacheChain *chain = &cache->chains[sweep->chain];
+  if (chain->swept)
+  {
+    printf("The chain of %s is already swept\n", tip_link.c_str());
+    return false;
+  }
+
+  sweep->cache = cache;
+  sweep->root_segment = root - chain->first_link;
+  sweep->first_link = chain->first_link;
+  sweep->tip_link = tip;
+  sweep->qd = qd;
+  sweep->num_segments = chain->chain.getNrOfSegments();
+  if (sweep->root_segment < 0 || sweep->root_segment >= sweep->num_segments)
+  {
+    printf("%s is not on the chain of %s\n", root_link.c_str(), tip_link.c_str());
+    return false;
+  }
+
+  sweep->nj = 0;
+  for (int i = 0; i < sweep->num_segments; i++)
+  {
+    const KDL::Segment &segment = chain->chain.getSegment(i);
+    KDL::Joint::JointType type = segment.getJoint().getType();
+
+    sweep->joint[i] = -1;
+    if (type != KDL::Joint::None)
+    {
+      if (i <= sweep->root_segment)
+      {
+        printf("The joints up to %s must be fixed\n", root_link.c_str());
+        return false;
+      }
+      if (type != KDL::Joint::RotAxis && type != KDL::Joint::RotX &&
+          type != KDL::Joint::RotY && type != KDL::Joint::RotZ)
+      {
+        printf("Only revolute joints are supported by the sweep of %s\n", tip_link.c_str());
+        return false;
+      }
+      if (sweep->nj >= ACHD_SWEEP_MAX_JOINTS)
+      {
+        printf("Too many joints for the sweep of %s\n", tip_link.c_str());
+        return false;
+      }
+      sweep->joint[i] = sweep->nj++;
+    }
+
+    // the rotational inertia of KDL is w.r.t. the tip frame, moved to the cog
+    const KDL::RigidBodyInertia &body = segment.getInertia();
+    double m = body.getMass();
+    KDL::Vector c = body.getCOG();
+    KDL::RotationalInertia about_tip = body.getRotationalInertia();
+    double cc[3] = {c.x(), c.y(), c.z()};
+    double c2 = cc[0] * cc[0] + cc[1] * cc[1] + cc[2] * cc[2];
+
+    sweep->mass[i] = m;
+    sweep->cog[i] = c;
+    for (int r = 0; r < 3; r++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        sweep->inertia[i][3 * r + k] =
+            about_tip.data[3 * r + k] - m * ((r == k ? c2 : 0.0) - cc[r] * cc[k]);
+      }
+    }
+  }
+
+  for (int i = 0; i < sweep->num_segments; i++)
+  {
+    for (int k = 0; k < 6; k++)
+    {
+      sweep->wrenches[i][k] = 0.0;
+    }
+  }
+
+  sweep->sweeps = 0;
+  sweep->solves = 0;
+  sweep->singular_solves = 0;
+
+  chain->swept = true;
+  return true;
+}
+
+/**
+ * initialize_achd_sweep for the sweeps and solves sized at generation time,
+ * fails if the chain does not have NJ joints.
+ */
+template <int NJ>
+inline bool initialize_achd_sweep(AchdSweep *sweep, FkCache *cache, const std::string &root_link,
+                                  const std::string &tip_link, const double *qd)
+{
+  if (!initialize_achd_sweep(sweep, cache, root_link, tip_link, qd))
+  {
+    return false;
+  }
+  if (sweep->nj != NJ)
+  {
+    printf("The chain of %s has %d joints, the loop was generated for %d\n", tip_link.c_str(),
+           sweep->nj, NJ);
+    cache->chains[sweep->chain].swept = false;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Spatial inertia, w.r.t. the origin, of a segment with the pose `pose`.
+ */
+inline void achd_sweep_body_inertia(const AchdSweep *sweep, int segment, const KDL::Frame &pose,
+                                    double (*out)[6])
+{
+  double m = sweep->mass[segment];
+  KDL::Vector c = pose * sweep->cog[segment];
+  double cc[3] = {c.x(), c.y(), c.z()};
+
+  // rotational inertia about the cog: R I R^T
+  const double *local = sweep->inertia[segment];
+  const double *R = pose.M.data;
+  double ri[3][3];
+  double ic[3][3];
+  for (int r = 0; r < 3; r++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      ri[r][k] = R[3 * r] * local[k] + R[3 * r + 1] * local[3 + k] + R[3 * r + 2] * local[6 + k];
+    }
+  }
+  for (int r = 0; r < 3; r++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      ic[r][k] = ri[r][0] * R[3 * k] + ri[r][1] * R[3 * k + 1] + ri[r][2] * R[3 * k + 2];
+    }
+  }
+
+  // [[m E, -m [c]], [m [c], Ic - m [c][c]]]
+  double skew[3][3] = {{0.0, -cc[2], cc[1]}, {cc[2], 0.0, -cc[0]}, {-cc[1], cc[0], 0.0}};
+  double c2 = cc[0] * cc[0] + cc[1] * cc[1] + cc[2] * cc[2];
+  for (int r = 0; r < 3; r++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      out[r][k] = r == k ? m : 0.0;
+      out[r][3 + k] = -m * skew[r][k];
+      out[3 + r][k] = m * skew[r][k];
+      out[3 + r][3 + k] = ic[r][k] + m * ((r == k ? c2 : 0.0) - cc[r] * cc[k]);
+    }
+  }
+}
+
+/**
+ * Walks the chain of the arm once outward and once inward, to be called once
+ * per cycle after get_robot_data, in place of update_fk_cache for this arm.
+ *
+ * NJ is the number of joints of the arm fixed at generation time, the sweep
+ * then builds and factorizes the joint space inertia with constant bounds;
+ * ACHD_SWEEP_DYNAMIC takes it from the chain.
+ *
+ * @param root_acceleration acceleration (linear, angular) of the root link
+ *                          expressed in the root link, NULL for none
+ */
+template <int NJ>
+inline void update_achd_sweep(AchdSweep *sweep, const double *root_acceleration)
+{
+  static_assert(NJ >= 0 && NJ <= ACHD_SWEEP_MAX_JOINTS, "unsupported number of joints");
+  const int nj = NJ != ACHD_SWEEP_DYNAMIC ? NJ : sweep->nj;
+
+  FkCache *cache = sweep->cache;
+  const FkCacheChain *chain = &cache->chains[sweep->chain];
+
+  KDL::Frame pose = KDL::Frame::Identity();
+  double velocity[6] = {};
+  double acceleration[6] = {};
+
+  // outward: poses, joint twists, velocities, bias accelerations and forces
+  for (int i = 0; i < sweep->num_segments; i++)
+  {
+    const KDL::Segment &segment = chain->chain.getSegment(i);
+    KDL::Frame parent = pose;
+    int j = sweep->joint[i];
+
+    pose = pose * segment.pose(j < 0 ? 0.0 : chain->q[j]);
+    cache->frames[sweep->first_link + i] = pose;
+
+    if (i == sweep->root_segment && root_acceleration != NULL)
+    {
+      KDL::Vector linear = pose.M * KDL::Vector(root_acceleration[0], root_acceleration[1],
+                                                root_acceleration[2]);
+      KDL::Vector angular = pose.M * KDL::Vector(root_acceleration[3], root_acceleration[4],
+                                                 root_acceleration[5]);
+      acceleration[0] = linear.x();
+      acceleration[1] = linear.y();
+      acceleration[2] = linear.z();
+      acceleration[3] = angular.x();
+      acceleration[4] = angular.y();
+      acceleration[5] = angular.z();
+    }
+    if (i <= sweep->root_segment)
+    {
+      continue;
+    }
+
+    if (j >= 0)
+    {
+      KDL::Vector axis = parent.M * segment.getJoint().JointAxis();
+      KDL::Vector origin = parent * segment.getJoint().JointOrigin();
+      double *twist = sweep->twists[j];
+      achd_sweep_cross(origin, axis.data, twist);
+      twist[3] = axis.x();
+      twist[4] = axis.y();
+      twist[5] = axis.z();
+
+      double qd = sweep->qd[j];
+      for (int k = 0; k < 6; k++)
+      {
+        velocity[k] += twist[k] * qd;
+      }
+
+      // velocity x (twist qd)
+      KDL::Vector v(velocity[0], velocity[1], velocity[2]);
+      KDL::Vector w(velocity[3], velocity[4], velocity[5]);
+      double wxs[3], vxs[3], wxsw[3];
+      achd_sweep_cross(w, twist, wxs);
+      achd_sweep_cross(v, twist + 3, vxs);
+      achd_sweep_cross(w, twist + 3, wxsw);
+      for (int k = 0; k < 3; k++)
+      {
+        acceleration[k] += (wxs[k] + vxs[k]) * qd;
+        acceleration[3 + k] += wxsw[k] * qd;
+      }
+    }
+
+    // f = I a + velocity x* (I velocity)
+    double (*inertia)[6] = sweep->body_inertia[i];
+    achd_sweep_body_inertia(sweep, i, pose, inertia);
+
+    double momentum[6];
+    double *force = sweep->body_force[i];
+    for (int r = 0; r < 6; r++)
+    {
+      momentum[r] = 0.0;
+      force[r] = 0.0;
+      for (int k = 0; k < 6; k++)
+      {
+        momentum[r] += inertia[r][k] * velocity[k];
+        force[r] += inertia[r][k] * acceleration[k];
+      }
+    }
+    KDL::Vector v(velocity[0], velocity[1], velocity[2]);
+    KDL::Vector w(velocity[3], velocity[4], velocity[5]);
+    double wxf[3], wxm[3], vxf[3];
+    achd_sweep_cross(w, momentum, wxf);
+    achd_sweep_cross(w, momentum + 3, wxm);
+    achd_sweep_cross(v, momentum, vxf);
+    for (int k = 0; k < 3; k++)
+    {
+      force[k] += wxf[k];
+      force[3 + k] += wxm[k] + vxf[k];
+    }
+  }
+
+  KDL::Vector tip = cache->frames[sweep->tip_link].p;
+  achd_sweep_ref_point(acceleration, tip, sweep->tip_bias);
+  for (int j = 0; j < nj; j++)
+  {
+    achd_sweep_ref_point(sweep->twists[j], tip, sweep->jacobian[j]);
+  }
+
+  // inward: bias torques and the composite inertias of the subtrees
+  double force[6] = {};
+  double composite[6][6] = {};
+  for (int i = sweep->num_segments - 1; i > sweep->root_segment; i--)
+  {
+    for (int r = 0; r < 6; r++)
+    {
+      force[r] += sweep->body_force[i][r];
+      for (int k = 0; k < 6; k++)
+      {
+        composite[r][k] += sweep->body_inertia[i][r][k];
+      }
+    }
+
+    int j = sweep->joint[i];
+    if (j < 0)
+    {
+      continue;
+    }
+
+    sweep->bias_torques[j] = achd_sweep_dot(sweep->twists[j], force);
+    for (int r = 0; r < 6; r++)
+    {
+      sweep->composite_twists[j][r] = 0.0;
+      for (int k = 0; k < 6; k++)
+      {
+        sweep->composite_twists[j][r] += composite[r][k] * sweep->twists[j][k];
+      }
+    }
+  }
+
+  // M(r, j) = twist_r . Ic_j twist_j for r <= j, factorized
+  for (int j = 0; j < nj; j++)
+  {
+    for (int r = j; r < nj; r++)
+    {
+      sweep->mass_factor[r][j] = achd_sweep_dot(sweep->twists[j], sweep->composite_twists[r]);
+    }
+  }
+  achd_sweep_cholesky<ACHD_SWEEP_MAX_JOINTS>(sweep->mass_factor, nj, 0.0);
+
+  sweep->sweeps++;
+  cache->chain_evaluations++;
+}
+
+inline void update_achd_sweep(AchdSweep *sweep, const double *root_acceleration)
+{
+  update_achd_sweep<ACHD_SWEEP_DYNAMIC>(sweep, root_acceleration);
+}
+
+/**
+ * Body of achd_sweep_solve, sized by NJ and NC where they are not
+ * ACHD_SWEEP_DYNAMIC and else by the chain and `num_constraints`. More
+ * constraints than ACHD_SWEEP_MAX_CONSTRAINTS would overflow the systems on
+ * the stack, the generator rejects them where it knows their number and the
+ * solve exits for the others.
+ */
+template <int NJ, int NC>
+inline void achd_sweep_solve_sized(AchdSweep *sweep, double *const *alpha, int num_constraints,
+                                   const double *beta, const double *tau_ff,
+                                   double *predicted_accelerations, double *constraint_torques)
+{
+  static_assert(NJ >= 0 && NJ <= ACHD_SWEEP_MAX_JOINTS, "unsupported number of joints");
+  static_assert(NC >= 0 && NC <= ACHD_SWEEP_MAX_CONSTRAINTS, "unsupported number of constraints");
+  constexpr int max_nj = NJ != ACHD_SWEEP_DYNAMIC ? NJ : ACHD_SWEEP_MAX_JOINTS;
+  constexpr int max_nc = NC != ACHD_SWEEP_DYNAMIC ? NC : ACHD_SWEEP_MAX_CONSTRAINTS;
+  const int nj = NJ != ACHD_SWEEP_DYNAMIC ? NJ : sweep->nj;
+  const int nc = NC != ACHD_SWEEP_DYNAMIC ? NC : num_constraints;
+  const double (*mass_factor)[ACHD_SWEEP_MAX_JOINTS] = sweep->mass_factor;
+
+  if (nc < 0 || nc > max_nc)
+  {
+    printf("The ACHD sweep solves at most %d constraints, %d given\n", max_nc, nc);
+    exit(1);
+  }
+
+  // joint space projections of the constraints: L = A^T J, b = A^T tip_bias
+  double projection[max_nc][max_nj];
+  double bias[max_nc];
+  for (int c = 0; c < nc; c++)
+  {
+    for (int j = 0; j < nj; j++)
+    {
+      projection[c][j] = achd_sweep_dot(alpha[c], sweep->jacobian[j]);
+    }
+    bias[c] = achd_sweep_dot(alpha[c], sweep->tip_bias);
+  }
+
+  // unconstrained accelerations M^-1 (tau_ff - h) and M^-1 L^T
+  double free_acceleration[max_nj];
+  for (int j = 0; j < nj; j++)
+  {
+    free_acceleration[j] = tau_ff[j] - sweep->bias_torques[j];
+  }
+  achd_sweep_cholesky_solve<ACHD_SWEEP_MAX_JOINTS>(mass_factor, nj, free_acceleration);
+
+  double response[max_nc][max_nj];
+  for (int c = 0; c < nc; c++)
+  {
+    for (int j = 0; j < nj; j++)
+    {
+      response[c][j] = projection[c][j];
+    }
+    achd_sweep_cholesky_solve<ACHD_SWEEP_MAX_JOINTS>(mass_factor, nj, response[c]);
+  }
+
+  // (L M^-1 L^T) nu = beta - b - L M^-1 (tau_ff - h)
+  double inertia[max_nc][max_nc];
+  double nu[max_nc];
+  for (int c = 0; c < nc; c++)
+  {
+    nu[c] = beta[c] - bias[c];
+    for (int j = 0; j < nj; j++)
+    {
+      nu[c] -= projection[c][j] * free_acceleration[j];
+    }
+    for (int k = 0; k <= c; k++)
+    {
+      inertia[c][k] = 0.0;
+      for (int j = 0; j < nj; j++)
+      {
+        inertia[c][k] += projection[c][j] * response[k][j];
+      }
+    }
+  }
+  if (!achd_sweep_cholesky<max_nc>(inertia, nc, ACHD_SWEEP_REGULARIZATION))
+  {
+    sweep->singular_solves++;
+  }
+  achd_sweep_cholesky_solve<max_nc>(inertia, nc, nu);
+
+  for (int j = 0; j < nj; j++)
+  {
+    constraint_torques[j] = 0.0;
+    double acceleration = free_acceleration[j];
+    for (int c = 0; c < nc; c++)
+    {
+      constraint_torques[j] += projection[c][j] * nu[c];
+      acceleration += response[c][j] * nu[c];
+    }
+    if (predicted_accelerations != NULL)
+    {
+      predicted_accelerations[j] = acceleration;
+    }
+  }
+
+  sweep->solves++;
+}
+
+/**
+ * As transform_alpha followed by achd_solver, from the last sweep, with the
+ * number of joints NJ and of constraints NC of the solver fixed at
+ * generation time. The dense systems are then of constant size on the stack
+ * and their loops unroll.
+ *
+ * @param alpha NC unit constraint forces (linear, angular) on the tip,
+ *              expressed in FK_CACHE_ROOT
+ * @param beta acceleration energy of each constraint
+ * @param predicted_accelerations joint accelerations, NULL if not needed
+ * @param constraint_torques joint torques of the constraint forces
+ */
+template <int NJ, int NC>
+inline void achd_sweep_solve(AchdSweep *sweep, double *const *alpha, const double *beta,
+                             const double *tau_ff, double *predicted_accelerations,
+                             double *constraint_torques)
+{
+  static_assert(NJ > 0 && NC > 0, "use the achd_sweep_solve sized at run time");
+  achd_sweep_solve_sized<NJ, NC>(sweep, alpha, NC, beta, tau_ff, predicted_accelerations,
+                                 constraint_torques);
+}
+
+/**
+ * achd_sweep_solve for the chains and constraints the solver was not
+ * generated for, sized at run time.
+ */
+inline void achd_sweep_solve(AchdSweep *sweep, double *const *alpha, int nc, const double *beta,
+                             const double *tau_ff, double *predicted_accelerations,
+                             double *constraint_torques)
+{
+  achd_sweep_solve_sized<ACHD_SWEEP_DYNAMIC, ACHD_SWEEP_DYNAMIC>(
+      sweep, alpha, nc, beta, tau_ff, predicted_accelerations, constraint_torques);
+}
+
+/**
+ * Adds a wrench (force, moment about the origin of the link) applied at a
+ * link of the arm, expressed in `asb`, to the wrenches of the next
+ * achd_sweep_wrench_torques.
+ *
+ * @param link cache ID of the link, from fk_cache_link_id
+ */
+inline void achd_sweep_add_wrench(AchdSweep *sweep, int link, int asb, const double *wrench)
+{
+  int segment = link - sweep->first_link;
+  if (segment <= sweep->root_segment || segment >= sweep->num_segments)
+  {
+    printf("Link %d is not a moving link of the arm, wrench ignored\n", link);
+    return;
+  }
+
+  const KDL::Frame *frames = sweep->cache->frames;
+  KDL::Vector force = frames[asb].M * KDL::Vector(wrench[0], wrench[1], wrench[2]);
+  KDL::Vector moment = frames[asb].M * KDL::Vector(wrench[3], wrench[4], wrench[5]);
+  moment = moment + frames[link].p * force;
+
+  double *sum = sweep->wrenches[segment];
+  sum[0] += force.x();
+  sum[1] += force.y();
+  sum[2] += force.z();
+  sum[3] += moment.x();
+  sum[4] += moment.y();
+  sum[5] += moment.z();
+}
+
+/**
+ * Adds the joint torques J_i^T w_i of the wrenches added since the last call
+ * to `torques`, and clears the wrenches. The wrenches are summed inward, so
+ * that every joint projects the wrench on its subtree once.
+ */
+inline void achd_sweep_add_wrench_torques(AchdSweep *sweep, double *torques)
+{
+  double force[6] = {};
+  for (int i = sweep->num_segments - 1; i > sweep->root_segment; i--)
+  {
+    for (int k = 0; k < 6; k++)
+    {
+      force[k] += sweep->wrenches[i][k];
+      sweep->wrenches[i][k] = 0.0;
+    }
+
+    int j = sweep->joint[i];
+    if (j >= 0)
+    {
+      torques[j] += achd_sweep_dot(sweep->twists[j], force);
+    }
+  }
+}
+
+/**
+ * As achd_solver_fext: the joint torques J_i^T w_i of the wrenches added
+ * since the last call, which are cleared.
+ */
+inline void achd_sweep_wrench_torques(AchdSweep *sweep, double *torques)
+{
+  for (int j = 0; j < sweep->nj; j++)
+  {
+    torques[j] = 0.0;
+  }
+  achd_sweep_add_wrench_torques(sweep, torques);
+}
+
+/**
+ * achd_sweep_solve and achd_sweep_wrench_torques of the same arm in one
+ * call, for an achd_solver that takes over the wrenches of the
+ * achd_solver_fext of its arm: `torques` are the constraint torques plus
+ * the torques of the wrenches added since the last call, i.e. the sum of
+ * both outputs without the second output and the add. The predicted
+ * accelerations are the ones of the constraint solve, as before.
+ */
+template <int NJ, int NC>
+inline void achd_sweep_solve_with_wrenches(AchdSweep *sweep, double *const *alpha,
+                                           const double *beta, const double *tau_ff,
+                                           double *predicted_accelerations, double *torques)
+{
+  achd_sweep_solve<NJ, NC>(sweep, alpha, beta, tau_ff, predicted_accelerations, torques);
+  achd_sweep_add_wrench_torques(sweep, torques);
+}
+
+/**
+ * achd_sweep_solve_with_wrenches sized at run time.
+ */
+inline void achd_sweep_solve_with_wrenches(AchdSweep *sweep, double *const *alpha, int nc,
+                                           const double *beta, const double *tau_ff,
+                                           double *predicted_accelerations, double *torques)
+{
+  achd_sweep_solve(sweep, alpha, nc, beta, tau_ff, predicted_accelerations, torques);
+  achd_sweep_add_wrench_torques(sweep, torques);
+}
+
+inline void print_achd_sweep_report(FILE *file, const char *name, const AchdSweep *sweep)
+{
+  fprintf(file, "%s sweep: %ld sweeps, %ld solves, %ld singular\n", name, sweep->sweeps,
+          sweep->solves, sweep->singular_solves);
+}
+
+#endif  // ACHD_SWEEP_HPP
@@ -0,0 +1,176 @@
+#ifndef ACTUATION_STAGE_HPP
+#define ACTUATION_STAGE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+
+#include "cycle_histogram.hpp"
+#include "cycle_scheduler.hpp"
+#include "io_workers.hpp"
+#include "rt_setup.hpp"
+
+/**
+ * Asynchronous actuation: the control thread writes the commands of a cycle
+ * into per-device outboxes and flushes them, one io worker per device sends
+ * its outbox while the control thread goes back to sleep. All devices get
+ * their commands at the same time instead of one after the other.
+ *
+ * The outboxes belong to the workers from the flush until the next sync,
+ * which the control thread calls before it touches the devices or the
+ * outboxes again, i.e. before acquiring the next samples.
+ */
+struct ActuationOutbox
+{
+  const char *name;
+  std::function<void()> send;  // sends the outbox, returns once the device acknowledged
+
+  // written by the worker
+  std::atomic<int64_t> acknowledged_ns;
+  CycleHistogram dispatch;     // from the flush until the worker starts sending [ns]
+  CycleHistogram acknowledge;  // from the flush until the device acknowledged [ns]
+};
+
+struct ActuationStage
+{
+  IoWorkers workers;
+  ActuationOutbox outboxes[IO_WORKERS_MAX];
+  int num_outboxes;
+
+  int64_t flush_ns;  // instant of the last flush, read by the workers
+  bool in_flight;
+
+  // control thread
+  long late;            // syncs that had to wait for a device
+  CycleHistogram sync;  // waiting for the previous commands [ns]
+  CycleHistogram skew;  // between the first and the last device acknowledging a flush [ns]
+};
+
+/**
+ * @param rt_config real-time configuration of the process, the workers are
+ *                  pinned to its helper cpus, NULL to keep the affinity
+ */
+inline void initialize_actuation_stage(ActuationStage *stage, const RtConfig *rt_config)
+{
+  initialize_io_workers(&stage->workers, rt_config);
+  stage->num_outboxes = 0;
+  stage->flush_ns = 0;
+  stage->in_flight = false;
+  stage->late = 0;
+  initialize_cycle_histogram(&stage->sync);
+  initialize_cycle_histogram(&stage->skew);
+}
+
+/**
+ * @param send sends the outbox of the device, called on its io worker
+ */
+inline int add_actuation_outbox(ActuationStage *stage, const char *name,
+                                std::function<void()> send)
+{
+  if (stage->num_outboxes >= IO_WORKERS_MAX)
+  {
+    printf("Too many actuation outboxes, not adding %s\n", name);
+    return -1;
+  }
+
+  ActuationOutbox *outbox = &stage->outboxes[stage->num_outboxes];
+  outbox->name = name;
+  outbox->send = send;
+  outbox->acknowledged_ns.store(0);
+  initialize_cycle_histogram(&outbox->dispatch);
+  initialize_cycle_histogram(&outbox->acknowledge);
+
+  add_io_worker(&stage->workers, name, [stage, outbox]() {
+    int64_t start_ns = cycle_scheduler_now_ns();
+    record_cycle_histogram(&outbox->dispatch, start_ns - stage->flush_ns);
+
+    outbox->send();
+
+    int64_t acknowledged_ns = cycle_scheduler_now_ns();
+    record_cycle_histogram(&outbox->acknowledge, acknowledged_ns - stage->flush_ns);
+    outbox->acknowledged_ns.store(acknowledged_ns, std::memory_order_relaxed);
+  });
+
+  return stage->num_outboxes++;
+}
+
+/**
+ * Starts the threads, after apply_rt_config so that they inherit the
+ * scheduling policy of the control thread.
+ */
+inline void start_actuation_stage(ActuationStage *stage)
+{
+  start_io_workers(&stage->workers);
+}
+
+/**
+ * Hands the outboxes to the workers, never blocks.
+ */
+inline void flush_actuation_stage(ActuationStage *stage)
+{
+  stage->flush_ns = cycle_scheduler_now_ns();
+  stage->in_flight = true;
+  io_workers_request(&stage->workers);
+}
+
+/**
+ * Waits until all devices acknowledged the last flush, to be called before
+ * the devices are accessed or the outboxes written again.
+ */
+inline void sync_actuation_stage(ActuationStage *stage)
+{
+  if (!stage->in_flight)
+  {
+    return;
+  }
+
+  for (int i = 0; i < stage->workers.num_workers; i++)
+  {
+    if (stage->workers.workers[i].completed.load(std::memory_order_acquire) !=
+        stage->workers.sequence)
+    {
+      stage->late++;
+      break;
+    }
+  }
+
+  io_workers_join(&stage->workers);
+  stage->in_flight = false;
+  record_cycle_histogram(&stage->sync, stage->workers.last_join_ns);
+
+  int64_t first_ns = INT64_MAX;
+  int64_t last_ns = 0;
+  for (int i = 0; i < stage->num_outboxes; i++)
+  {
+    int64_t acknowledged_ns = stage->outboxes[i].acknowledged_ns.load(std::memory_order_relaxed);
+    first_ns = acknowledged_ns < first_ns ? acknowledged_ns : first_ns;
+    last_ns = acknowledged_ns > last_ns ? acknowledged_ns : last_ns;
+  }
+  if (stage->num_outboxes > 0)
+  {
+    record_cycle_histogram(&stage->skew, last_ns - first_ns);
+  }
+}
+
+inline void stop_actuation_stage(ActuationStage *stage)
+{
+  sync_actuation_stage(stage);
+  stop_io_workers(&stage->workers);
+}
+
+inline void print_actuation_stage_report(FILE *file, const ActuationStage *stage)
+{
+  for (int i = 0; i < stage->num_outboxes; i++)
+  {
+    const ActuationOutbox *outbox = &stage->outboxes[i];
+    fprintf(file, "actuation %s\n", outbox->name);
+    print_cycle_histogram_summary(file, "dispatch", &outbox->dispatch);
+    print_cycle_histogram_summary(file, "ack", &outbox->acknowledge);
+  }
+  fprintf(file, "actuation late syncs: %ld\n", stage->late);
+  print_cycle_histogram_summary(file, "sync", &stage->sync);
+  print_cycle_histogram_summary(file, "skew", &stage->skew);
+}
+
+#endif  // ACTUATION_STAGE_HPP
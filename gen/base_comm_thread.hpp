@@ -0,0 +1,195 @@
+#ifndef BASE_COMM_THREAD_HPP
+#define BASE_COMM_THREAD_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include <motion_spec_utils/utils.hpp>
+
+#include "cycle_histogram.hpp"
+#include "cycle_scheduler.hpp"
+#include "rt_setup.hpp"
+#include "spsc_channel.hpp"
+
+/**
+ * Thread that owns the EtherCAT exchange of the mobile base.
+ *
+ * The control thread publishes the wheel torques of a cycle to `commands`.
+ * The communication thread sends them, updates the base state and publishes
+ * the completion to `feedback`. Before reading the base state in the next
+ * cycle, the control thread polls the feedback of its last command without
+ * waiting. Once the exchange is complete the EtherCAT buffers hold the latest
+ * base state and stay untouched until the next command. While it is still
+ * running the cycle holds the robot data of the last one, so the two threads
+ * never access the buffers at the same time.
+ *
+ * Both directions are SpscChannels, the control thread is never blocked by
+ * the communication thread. The thread runs with the scheduling policy of the
+ * control thread on the helper cpus of the real-time configuration.
+ */
+struct BaseTorqueCommand
+{
+  double tau[8];
+  int64_t publish_ns;
+};
+
+struct BaseCommFeedback
+{
+  uint32_t command;    // sequence number of the command that was sent
+  int64_t updated_ns;  // instant the base state was updated
+};
+
+struct BaseCommThread
+{
+  Freddy *robot;
+  int64_t spin_ns;  // time a waiting thread spins before it sleeps
+  const RtConfig *rt_config;
+
+  SpscChannel<BaseTorqueCommand> commands;  // control -> communication thread
+  SpscChannel<BaseCommFeedback> feedback;   // communication -> control thread
+  std::thread thread;
+
+  // control thread
+  uint32_t pending;  // sequence number of the last command, 0 before the first
+  uint32_t feedback_seen;
+  BaseCommFeedback last_feedback;
+  double nominal_dt;     // s
+  double state_dt;       // s, between the last two base states read
+  int64_t state_ns;      // instant the base state read last was updated
+  long polls;
+  long held;             // polls while the exchange was still running
+
+  // communication thread
+  CycleHistogram wake_up;   // from publishing a command to picking it up [ns]
+  CycleHistogram exchange;  // sending the torques and updating the state [ns]
+};
+
+inline void base_comm_thread_run(BaseCommThread *comm)
+{
+  // the thread inherits the affinity and policy of the thread that started it
+  if (comm->rt_config != NULL)
+  {
+    if (set_rt_helper_affinity(comm->rt_config) != 0)
+    {
+      printf("Failed to pin the base communication thread to the helper cpus\n");
+    }
+    if (set_rt_thread_policy(comm->rt_config) != 0)
+    {
+      printf("Failed to set the scheduling policy of the base communication thread\n");
+    }
+  }
+
+  BaseTorqueCommand command;
+  uint32_t seen = 0;
+  while (spsc_channel_wait(&comm->commands, &command, &seen, comm->spin_ns))
+  {
+    int64_t start_ns = cycle_scheduler_now_ns();
+    record_cycle_histogram(&comm->wake_up, start_ns - command.publish_ns);
+
+    set_mobile_base_torques(comm->robot, command.tau);
+    update_base_state(comm->robot->mobile_base->mediator->kelo_base_config,
+                      comm->robot->mobile_base->mediator->ethercat_config);
+
+    BaseCommFeedback feedback;
+    feedback.command = seen;
+    feedback.updated_ns = cycle_scheduler_now_ns();
+    spsc_channel_publish(&comm->feedback, &feedback);
+
+    record_cycle_histogram(&comm->exchange, feedback.updated_ns - start_ns);
+  }
+}
+
+/**
+ * @param spin_duration time a waiting thread spins before it sleeps [s]
+ * @param nominal_dt period of the control loop [s]
+ * @param rt_config real-time configuration of the process, the thread gets its
+ *                  policy and helper cpus, NULL to inherit them
+ */
+inline void start_base_comm_thread(BaseCommThread *comm, Freddy *robot, double spin_duration,
+                                   double nominal_dt, const RtConfig *rt_config)
+{
+  comm->robot = robot;
+  comm->spin_ns = (int64_t)(spin_duration * NS_PER_SECOND);
+  comm->rt_config = rt_config;
+
+  initialize_spsc_channel(&comm->commands);
+  initialize_spsc_channel(&comm->feedback);
+
+  comm->pending = 0;
+  comm->feedback_seen = 0;
+  comm->last_feedback = {};
+  comm->nominal_dt = nominal_dt;
+  comm->state_dt = nominal_dt;
+  comm->state_ns = 0;
+  comm->polls = 0;
+  comm->held = 0;
+  initialize_cycle_histogram(&comm->wake_up);
+  initialize_cycle_histogram(&comm->exchange);
+
+  comm->thread = std::thread(base_comm_thread_run, comm);
+}
+
+/**
+ * Hands the wheel torques over to the communication thread, never blocks.
+ */
+inline void base_comm_send_torques(BaseCommThread *comm, const double *tau)
+{
+  BaseTorqueCommand command;
+  std::copy(tau, tau + 8, command.tau);
+  command.publish_ns = cycle_scheduler_now_ns();
+  comm->pending = spsc_channel_publish(&comm->commands, &command);
+}
+
+/**
+ * Checks whether the last command was sent and the base state updated, never
+ * blocks. Updates the base state itself before the first command.
+ *
+ * @return true if get_robot_data may read the base state, over state_dt since
+ *         the one read before, false to hold the robot data of the last cycle
+ */
+inline bool base_comm_poll(BaseCommThread *comm)
+{
+  comm->polls++;
+
+  int64_t updated_ns;
+  if (comm->pending == 0)
+  {
+    update_base_state(comm->robot->mobile_base->mediator->kelo_base_config,
+                      comm->robot->mobile_base->mediator->ethercat_config);
+    updated_ns = cycle_scheduler_now_ns();
+  }
+  else
+  {
+    spsc_channel_read(&comm->feedback, &comm->last_feedback, &comm->feedback_seen);
+    if (comm->last_feedback.command != comm->pending)
+    {
+      comm->held++;
+      return false;
+    }
+    updated_ns = comm->last_feedback.updated_ns;
+  }
+
+  comm->state_dt = comm->state_ns == 0 ? comm->nominal_dt
+                                       : (double)(updated_ns - comm->state_ns) / NS_PER_SECOND;
+  comm->state_ns = updated_ns;
+  return true;
+}
+
+inline void stop_base_comm_thread(BaseCommThread *comm)
+{
+  close_spsc_channel(&comm->commands);
+  comm->thread.join();
+}
+
+inline void print_base_comm_report(FILE *file, const BaseCommThread *comm)
+{
+  print_cycle_histogram_summary(file, "wake-up", &comm->wake_up);
+  print_cycle_histogram_summary(file, "exchange", &comm->exchange);
+  fprintf(file, "base state held: %ld of %ld cycles, the exchange was still running\n",
+          comm->held, comm->polls);
+}
+
+#endif  // BASE_COMM_THREAD_HPP
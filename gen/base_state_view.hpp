@@ -0,0 +1,115 @@
+#ifndef BASE_STATE_VIEW_HPP
+#define BASE_STATE_VIEW_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#include <motion_spec_utils/utils.hpp>
+
+/**
+ * Read-only view of the measured state of the Kelo base, pointing into the
+ * arrays that hold the measurements instead of copying them: the PDO-decoded
+ * kelo_msr arrays filled by the robif2b encoder update, or the MobileBaseState
+ * filled by kelo_motion_control. Code written against the view, such as the
+ * pivot alignment below, is shared by both backends.
+ *
+ * The view is only valid as long as the arrays it points to, in a loop with an
+ * EtherCAT thread it is re-pointed to the triple buffer slot read each cycle.
+ */
+struct BaseStateView
+{
+  int num_drives;
+  const double *pivot_angles;       // [rad], one per drive
+  const double *pivot_velocities;   // [rad/s], one per drive, NULL if not measured
+  const double *wheel_positions;    // [rad], two per drive
+  const double *wheel_velocities;   // [rad/s], two per drive
+  const double *wheel_coordinates;  // x, y of each pivot in the base frame [m]
+};
+
+/**
+ * @param msr kelo_msr of a robif2b loop, with the pvt_pos, pvt_vel, whl_pos and
+ *            whl_vel arrays the robif2b drive encoder writes into
+ */
+template <typename KeloMsr>
+inline void point_base_state_view(BaseStateView *view, const KeloMsr *msr, int num_drives,
+                                  const double *wheel_coordinates)
+{
+  view->num_drives = num_drives;
+  view->pivot_angles = msr->pvt_pos;
+  view->pivot_velocities = msr->pvt_vel;
+  view->wheel_positions = msr->whl_pos;
+  view->wheel_velocities = msr->whl_vel;
+  view->wheel_coordinates = wheel_coordinates;
+}
+
+inline void point_base_state_view(BaseStateView *view, const MobileBaseState *state,
+                                  const KeloBaseConfig *config)
+{
+  view->num_drives = config->nWheels;
+  view->pivot_angles = state->pivot_angles;
+  view->pivot_velocities = NULL;
+  view->wheel_positions = state->wheel_encoder_values;
+  view->wheel_velocities = state->qd_wheel;
+  view->wheel_coordinates = config->wheel_coordinates;
+}
+
+/**
+ * Copies the measurements into the MobileBaseState, only needed for the
+ * motion_spec_utils functions that take the robot (get_robot_data, the
+ * odometry and the base solvers). Nothing to do if the view points into the
+ * state already.
+ */
+inline void write_mobile_base_state(const BaseStateView *view, MobileBaseState *state)
+{
+  if (view->pivot_angles == state->pivot_angles)
+  {
+    return;
+  }
+
+  for (int i = 0; i < view->num_drives; i++)
+  {
+    state->pivot_angles[i] = view->pivot_angles[i];
+  }
+  for (int i = 0; i < 2 * view->num_drives; i++)
+  {
+    state->wheel_encoder_values[i] = view->wheel_positions[i];
+    state->qd_wheel[i] = view->wheel_velocities[i];
+  }
+}
+
+/**
+ * Offsets of the pivots to the platform force, as get_pivot_alignment_offsets
+ * of motion_spec_utils but reading the pivot angles through the view.
+ *
+ * @param platform_force fx [N], fy [N], mz [Nm]
+ * @param lin_offsets angle from each pivot direction to the linear force [rad]
+ * @param ang_offsets angle from each pivot direction to the tangent of its
+ *                    attachment, counter-clockwise for a positive moment [rad]
+ */
+inline void compute_pivot_alignment_offsets(const BaseStateView *view,
+                                            const double *platform_force, double *lin_offsets,
+                                            double *ang_offsets)
+{
+  double lin_norm = std::hypot(platform_force[0], platform_force[1]);
+  double lin_x = lin_norm > 0.0 ? platform_force[0] / lin_norm : 0.0;
+  double lin_y = lin_norm > 0.0 ? platform_force[1] / lin_norm : 0.0;
+
+  for (int i = 0; i < view->num_drives; i++)
+  {
+    double pivot_x = std::cos(view->pivot_angles[i]);
+    double pivot_y = std::sin(view->pivot_angles[i]);
+
+    // attachment rotated by +-90 degrees
+    double attachment_x = view->wheel_coordinates[2 * i];
+    double attachment_y = view->wheel_coordinates[2 * i + 1];
+    double tangent_x = platform_force[2] > 0 ? -attachment_y : attachment_y;
+    double tangent_y = platform_force[2] > 0 ? attachment_x : -attachment_x;
+
+    ang_offsets[i] = std::atan2(pivot_x * tangent_y - pivot_y * tangent_x,
+                                pivot_x * tangent_x + pivot_y * tangent_y);
+    lin_offsets[i] = std::atan2(pivot_x * lin_y - pivot_y * lin_x,
+                                pivot_x * lin_x + pivot_y * lin_y);
+  }
+}
+
+#endif  // BASE_STATE_VIEW_HPP
@@ -0,0 +1,355 @@
+#include "kelo_motion_control/mediator.h"
+#include <array>
+#include <cstring>
+#include <string>
+#include <filesystem>
+#include <iostream>
+#include <controllers/pid_controller.hpp>
+#include <motion_spec_utils/utils.hpp>
+#include <motion_spec_utils/math_utils.hpp>
+#include <motion_spec_utils/solver_utils.hpp>
+#include <kinova_mediator/mediator.hpp>
+
+#include "cycle_scheduler.hpp"
+#include "cycle_histogram.hpp"
+#include "rt_setup.hpp"
+#include "fk_cache.hpp"
+#include "achd_sweep.hpp"
+#include "solver_worker.hpp"
+
+/**
+ * Measures the cost of the primitives the generated control loop is built
+ * from, on the kinematic model of freddy without connecting to the robot.
+ *
+ * The costs are written as json, keyed by the primitive names used by the
+ * cycle budget estimate of the generator (motion_spec_gen/ir_gen/cycle_budget.py):
+ *
+ *   ./cycle_budget_calibration [<output_file> [<cpu> [<worker_cpu>]]]
+ *
+ * Run it on the target computer, pinned to the cpu of the control loop and
+ * the solver worker, and pass the output to the runner with -c.
+ */
+
+#define CALIBRATION_WARMUP 200
+#define CALIBRATION_ITERATIONS 5000
+
+struct PrimitiveCost
+{
+  const char *name;
+  CycleHistogram histogram;  // [ns]
+  int64_t sum_ns;
+};
+
+template <typename Primitive>
+void calibrate_primitive(PrimitiveCost *cost, const char *name, Primitive primitive)
+{
+  cost->name = name;
+  cost->sum_ns = 0;
+  initialize_cycle_histogram(&cost->histogram);
+
+  for (int i = 0; i < CALIBRATION_WARMUP; i++)
+  {
+    primitive();
+  }
+
+  for (int i = 0; i < CALIBRATION_ITERATIONS; i++)
+  {
+    int64_t start_ns = cycle_scheduler_now_ns();
+    primitive();
+    int64_t ns = cycle_scheduler_now_ns() - start_ns;
+
+    cost->sum_ns += ns;
+    record_cycle_histogram(&cost->histogram, ns);
+  }
+
+  printf("%-36s mean: %9.3f us  p99: %9.3f us  max: %9.3f us\n", name,
+         (double)cost->sum_ns / CALIBRATION_ITERATIONS / 1e3,
+         cycle_histogram_percentile(&cost->histogram, 99.0) / 1e3, cost->histogram.max / 1e3);
+}
+
+void write_primitive_costs(const char *file_name, const PrimitiveCost *costs, int num_costs)
+{
+  FILE *file = fopen(file_name, "w");
+  if (file == NULL)
+  {
+    perror("fopen");
+    exit(1);
+  }
+
+  fprintf(file, "{\n");
+  for (int i = 0; i < num_costs; i++)
+  {
+    const PrimitiveCost *cost = &costs[i];
+    fprintf(file, "  \"%s\": {\"mean_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}%s\n",
+            cost->name, (double)cost->sum_ns / CALIBRATION_ITERATIONS / 1e3,
+            cycle_histogram_percentile(&cost->histogram, 99.0) / 1e3, cost->histogram.max / 1e3,
+            i < num_costs - 1 ? "," : "");
+  }
+  fprintf(file, "}\n");
+  fclose(file);
+
+  printf("Primitive costs written to %s\n", file_name);
+}
+
+int main(int argc, char **argv)
+{
+  const char *output_file = argc > 1 ? argv[1] : "primitive_costs.json";
+
+  // measure under the same conditions as the control loop
+  RtConfig rt_config = {};
+  rt_config.policy = SCHED_FIFO;
+  rt_config.priority = 80;
+  rt_config.control_cpu = argc > 2 ? atoi(argv[2]) : -1;
+  rt_config.num_helper_cpus = 0;
+  rt_config.lock_memory = true;
+  rt_config.prefault_stack_size = 512 * 1024;
+  rt_config.prefault_heap_size = 0;
+
+  RtReport rt_report;
+  apply_rt_config(&rt_config, &rt_report);
+  print_rt_report(&rt_config, &rt_report);
+
+  // Initialize the robot structs, without connecting to the robot
+  Manipulator<kinova_mediator> kinova_right;
+  kinova_right.base_frame = "kinova_right_base_link";
+  kinova_right.tool_frame = "kinova_right_bracelet_link";
+  kinova_right.mediator = nullptr;
+  kinova_right.state = new ManipulatorState();
+
+  KeloBaseConfig kelo_base_config;
+  kelo_base_config.nWheels = 4;
+  int index_to_EtherCAT[4] = {6, 7, 3, 4};
+  kelo_base_config.index_to_EtherCAT = index_to_EtherCAT;
+  kelo_base_config.radius = 0.115 / 2;
+  kelo_base_config.castor_offset = 0.01;
+  kelo_base_config.half_wheel_distance = 0.0775 / 2;
+  double wheel_coordinates[8] = {0.188, 0.2075, -0.188, 0.2075, -0.188, -0.2075, 0.188, -0.2075};
+  kelo_base_config.wheel_coordinates = wheel_coordinates;
+  double pivot_angles_deviation[4] = {5.310, 5.533, 1.563, 1.625};
+  kelo_base_config.pivot_angles_deviation = pivot_angles_deviation;
+
+  MobileBase<Robile> freddy_base;
+  Robile robile;
+  robile.ethercat_config = new EthercatConfig();
+  robile.kelo_base_config = &kelo_base_config;
+
+  freddy_base.mediator = &robile;
+  freddy_base.state = new MobileBaseState();
+
+  Manipulator<kinova_mediator> kinova_left;
+  kinova_left.base_frame = "kinova_left_base_link";
+  kinova_left.tool_frame = "kinova_left_bracelet_link";
+  kinova_left.mediator = nullptr;
+  kinova_left.state = new ManipulatorState();
+
+  Freddy robot = {&kinova_left, &kinova_right, &freddy_base};
+
+  // get current file path
+  std::filesystem::path path = __FILE__;
+
+  // get the robot urdf path
+  std::string robot_urdf = (path.parent_path().parent_path() / "urdf" / "freddy.urdf").string();
+
+  initialize_robot_sim(robot_urdf, &robot);
+
+  std::string base_link = "base_link";
+  std::string base_link_origin_point = "base_link";
+  std::string kinova_left_base_link = "kinova_left_base_link";
+  std::string kinova_left_bracelet_link = "kinova_left_bracelet_link";
+  std::string kinova_left_half_arm_2_link = "kinova_left_forearm_link";
+  std::string table = "table";
+
+  // compute variables
+  double position_vector[6] = {0, 1, 0, 0, 0, 0};
+  double position = 0.0;
+  double quaternion[4] = {0, 0, 0, 1};
+  double force_vector[6] = {0, 0, 1, 0, 0, 0};
+  double force = 0.0;
+  std::string distance_entities[2] = {kinova_left_bracelet_link, kinova_left_base_link};
+  double distance = 0.0;
+  std::string distance_1d_entities[2] = {kinova_left_half_arm_2_link, base_link};
+  double distance_1d_axis[6] = {0, 0, 1, 0, 0, 0};
+
+  // controllers
+  double pid_error = 0.01;
+  double pid_error_sum = 0.0;
+  double pid_prev_error = 0.0;
+  double pid_signal = 0.0;
+  double stiffness_diag_mat[1] = {300.0};
+  double damping_diag_mat[1] = {0.0};
+  double impedance_signal = 0.0;
+
+  // embed maps
+  double embed_map_vector[6] = {0, 0, 1, 0, 0, 0};
+  double embed_map_output[6]{};
+
+  // solvers
+  const int achd_solver_nc = 6;
+  double achd_solver_root_acceleration[6] = {-9.6, 0.92, 1.4, 0.0, 0.0, 0.0};
+  double achd_solver_alpha[achd_solver_nc][6] = {
+      {1.0, 0.0, 0.0, 0.0, 0.0, 0.0}, {0.0, 1.0, 0.0, 0.0, 0.0, 0.0},
+      {0.0, 0.0, 1.0, 0.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 1.0, 0.0, 0.0},
+      {0.0, 0.0, 0.0, 0.0, 1.0, 0.0}, {0.0, 0.0, 0.0, 0.0, 0.0, 1.0}};
+  double achd_solver_alpha_transf[achd_solver_nc][6];
+  double achd_solver_beta[achd_solver_nc]{};
+  double achd_solver_feed_forward_torques[7]{};
+  double achd_solver_predicted_accelerations[7]{};
+  double achd_solver_output_torques[7]{};
+  double achd_solver_fext_ext_wrenches[7][6]{};
+  double achd_solver_fext_output_torques[7]{};
+  double wrench[6] = {0, 0, 5.0, 0, 0, 0};
+  double wrench_transf[6]{};
+  double platform_force[3] = {10.0, 0.0, 1.0};
+  double base_fd_solver_output_torques[8]{};
+
+  static PrimitiveCost costs[24];
+  int num_costs = 0;
+
+  calibrate_primitive(&costs[num_costs++], "computePosition", [&]() {
+    getLinkPosition(kinova_left_bracelet_link, base_link, base_link_origin_point, position_vector,
+                    &robot, position);
+  });
+  calibrate_primitive(&costs[num_costs++], "computeQuaternion", [&]() {
+    getLinkQuaternion(kinova_left_bracelet_link, base_link, base_link_origin_point, &robot,
+                      quaternion);
+  });
+  calibrate_primitive(&costs[num_costs++], "computeForce", [&]() {
+    getLinkForce(kinova_left_bracelet_link, table, kinova_left_bracelet_link, force_vector, &robot,
+                 force);
+  });
+  calibrate_primitive(&costs[num_costs++], "computeDistance", [&]() {
+    computeDistance(distance_entities, kinova_left_bracelet_link, &robot, distance);
+  });
+  calibrate_primitive(&costs[num_costs++], "computeDistance1D", [&]() {
+    computeDistance1D(distance_1d_entities, distance_1d_axis, base_link, &robot, distance);
+  });
+  calibrate_primitive(&costs[num_costs++], "pid_controller", [&]() {
+    pidController(pid_error, 10.0, 1.0, 0.1, 0.001, pid_error_sum, 1.0, pid_prev_error,
+                  pid_signal);
+  });
+  calibrate_primitive(&costs[num_costs++], "impedance_controller", [&]() {
+    impedanceController(pid_error, 0.0, stiffness_diag_mat, damping_diag_mat, impedance_signal);
+  });
+  calibrate_primitive(&costs[num_costs++], "embed_mapping_vector", [&]() {
+    for (size_t i = 0; i < sizeof(embed_map_vector) / sizeof(embed_map_vector[0]); i++)
+    {
+      if (embed_map_vector[i] != 0.0)
+      {
+        embed_map_output[i] += impedance_signal;
+      }
+    }
+  });
+  calibrate_primitive(&costs[num_costs++], "embed_mapping_vector_info", [&]() {
+    decomposeSignal(&robot, kinova_left_base_link, kinova_left_bracelet_link,
+                    kinova_left_bracelet_link, pid_signal, embed_map_output);
+  });
+  calibrate_primitive(&costs[num_costs++], "transform_alpha", [&]() {
+    transform_alpha(&robot, base_link, kinova_left_base_link, achd_solver_alpha, achd_solver_nc,
+                    achd_solver_alpha_transf);
+  });
+  calibrate_primitive(&costs[num_costs++], "transform_wrench", [&]() {
+    transform_wrench(&robot, base_link, kinova_left_base_link, wrench, wrench_transf);
+  });
+  calibrate_primitive(&costs[num_costs++], "achd_solver", [&]() {
+    achd_solver(&robot, kinova_left_base_link, kinova_left_bracelet_link, achd_solver_nc,
+                achd_solver_root_acceleration, achd_solver_alpha_transf, achd_solver_beta,
+                achd_solver_feed_forward_torques, achd_solver_predicted_accelerations,
+                achd_solver_output_torques);
+  });
+  calibrate_primitive(&costs[num_costs++], "achd_solver_fext", [&]() {
+    achd_solver_fext(&robot, kinova_left_base_link, kinova_left_bracelet_link,
+                     achd_solver_fext_ext_wrenches, achd_solver_fext_output_torques);
+  });
+  calibrate_primitive(&costs[num_costs++], "base_fd_solver", [&]() {
+    base_fd_solver(&robot, platform_force, base_fd_solver_output_torques);
+  });
+
+  FkCache fk_cache;
+  if (!initialize_fk_cache(&fk_cache, robot_urdf, &robot))
+  {
+    return 1;
+  }
+  calibrate_primitive(&costs[num_costs++], "update_fk_cache", [&]() {
+    update_fk_cache(&fk_cache);
+  });
+  const int kinova_left_bracelet_link_id = fk_cache_link_id(&fk_cache, kinova_left_bracelet_link);
+  const int base_link_id = fk_cache_link_id(&fk_cache, base_link);
+  calibrate_primitive(&costs[num_costs++], "fk_cache_lookup", [&]() {
+    fk_cache_link_position(&fk_cache, kinova_left_bracelet_link_id, base_link_id, base_link_id,
+                           position_vector, position);
+  });
+
+  // the sweep of the left arm replaces its chain in update_fk_cache, sized
+  // as the generated loop sizes it
+  AchdSweep kinova_left_sweep;
+  if (!initialize_achd_sweep<7>(&kinova_left_sweep, &fk_cache, kinova_left_base_link,
+                             kinova_left_bracelet_link, kinova_left.state->q_dot))
+  {
+    return 1;
+  }
+  double *achd_sweep_alpha[achd_solver_nc];
+  for (int i = 0; i < achd_solver_nc; i++)
+  {
+    achd_sweep_alpha[i] = achd_solver_alpha[i];
+  }
+  const int kinova_left_half_arm_2_link_id =
+      fk_cache_link_id(&fk_cache, kinova_left_half_arm_2_link);
+  calibrate_primitive(&costs[num_costs++], "update_achd_sweep", [&]() {
+    update_achd_sweep<7>(&kinova_left_sweep, achd_solver_root_acceleration);
+  });
+  calibrate_primitive(&costs[num_costs++], "achd_sweep_solve", [&]() {
+    achd_sweep_solve<7, achd_solver_nc>(&kinova_left_sweep, achd_sweep_alpha, achd_solver_beta,
+                                        achd_solver_feed_forward_torques,
+                                        achd_solver_predicted_accelerations,
+                                        achd_solver_output_torques);
+  });
+  calibrate_primitive(&costs[num_costs++], "achd_sweep_add_wrench", [&]() {
+    achd_sweep_add_wrench(&kinova_left_sweep, kinova_left_half_arm_2_link_id, base_link_id,
+                          wrench);
+  });
+  calibrate_primitive(&costs[num_costs++], "achd_sweep_wrench_torques", [&]() {
+    achd_sweep_wrench_torques(&kinova_left_sweep, achd_solver_fext_output_torques);
+  });
+  calibrate_primitive(&costs[num_costs++], "achd_sweep_solve_with_wrenches", [&]() {
+    achd_sweep_solve_with_wrenches<7, achd_solver_nc>(
+        &kinova_left_sweep, achd_sweep_alpha, achd_solver_beta, achd_solver_feed_forward_torques,
+        achd_solver_predicted_accelerations, achd_solver_output_torques);
+  });
+
+  // one arm with an achd_solver and an achd_solver_fext with two external
+  // wrenches, the primitives called per cycle with and without the sweep
+  auto mean_us = [&](const char *name) {
+    for (int i = 0; i < num_costs; i++)
+    {
+      if (strcmp(costs[i].name, name) == 0)
+      {
+        return (double)costs[i].sum_ns / CALIBRATION_ITERATIONS / 1e3;
+      }
+    }
+    return 0.0;
+  };
+  double separate_us = mean_us("update_fk_cache") / fk_cache.num_chains +
+                       mean_us("transform_alpha") + mean_us("achd_solver") +
+                       2 * mean_us("transform_wrench") + mean_us("achd_solver_fext");
+  double swept_us = mean_us("update_achd_sweep") + mean_us("achd_sweep_solve") +
+                    2 * mean_us("achd_sweep_add_wrench") + mean_us("achd_sweep_wrench_torques");
+  double combined_us = mean_us("update_achd_sweep") + mean_us("achd_sweep_solve_with_wrenches") +
+                       2 * mean_us("achd_sweep_add_wrench");
+  printf("ACHD solvers of an arm: %.3f us separately, %.3f us swept, %.3f us combined\n",
+         separate_us, swept_us, combined_us);
+
+  // a fork and join of the solver worker without a job, the overhead of
+  // parallel_solvers on top of the slower part
+  static SolverWorker solver_worker;
+  initialize_solver_worker(&solver_worker, "calib", argc > 3 ? atoi(argv[3]) : -1, NULL, []() {});
+  start_solver_worker(&solver_worker);
+  calibrate_primitive(&costs[num_costs++], "solver_worker_dispatch", [&]() {
+    solver_worker_fork(&solver_worker);
+    solver_worker_join(&solver_worker);
+  });
+  stop_solver_worker(&solver_worker);
+
+  write_primitive_costs(output_file, costs, num_costs);
+
+  return 0;
+}
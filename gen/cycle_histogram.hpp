@@ -0,0 +1,237 @@
+#ifndef CYCLE_HISTOGRAM_HPP
+#define CYCLE_HISTOGRAM_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "cycle_scheduler.hpp"
+
+/**
+ * Log-linear (HDR style) histogram of durations in nanoseconds.
+ *
+ * Values below 2^CYCLE_HISTOGRAM_SUB_BITS are counted exactly. Above that,
+ * every power of two is split into 2^(CYCLE_HISTOGRAM_SUB_BITS - 1) linear
+ * sub-buckets, which bounds the relative error of a reported value to
+ * 1 / 64. The storage is fixed, so recording a value is O(1) and does not
+ * allocate.
+ */
+#define CYCLE_HISTOGRAM_SUB_BITS 7
+#define CYCLE_HISTOGRAM_MAX_BITS 40  // values are clamped to ~18 min
+#define CYCLE_HISTOGRAM_SUB_COUNT (1 << CYCLE_HISTOGRAM_SUB_BITS)
+#define CYCLE_HISTOGRAM_HALF_SUB_COUNT (CYCLE_HISTOGRAM_SUB_COUNT / 2)
+#define CYCLE_HISTOGRAM_SIZE                                                        \
+  (CYCLE_HISTOGRAM_SUB_COUNT +                                                      \
+   (CYCLE_HISTOGRAM_MAX_BITS - CYCLE_HISTOGRAM_SUB_BITS + 1) * CYCLE_HISTOGRAM_HALF_SUB_COUNT)
+
+struct CycleHistogram
+{
+  uint64_t counts[CYCLE_HISTOGRAM_SIZE];
+  uint64_t total;
+  int64_t min;
+  int64_t max;
+};
+
+inline void initialize_cycle_histogram(CycleHistogram *histogram)
+{
+  for (int i = 0; i < CYCLE_HISTOGRAM_SIZE; i++)
+  {
+    histogram->counts[i] = 0;
+  }
+  histogram->total = 0;
+  histogram->min = INT64_MAX;
+  histogram->max = 0;
+}
+
+inline int cycle_histogram_index(int64_t value)
+{
+  uint64_t v = value < 0 ? 0 : (uint64_t)value;
+  if (v >= (1ULL << CYCLE_HISTOGRAM_MAX_BITS))
+  {
+    v = (1ULL << CYCLE_HISTOGRAM_MAX_BITS) - 1;
+  }
+
+  if (v < CYCLE_HISTOGRAM_SUB_COUNT)
+  {
+    return (int)v;
+  }
+
+  int msb = 63 - __builtin_clzll(v);
+  int shift = msb - (CYCLE_HISTOGRAM_SUB_BITS - 1);
+  int sub = (int)(v >> shift) - CYCLE_HISTOGRAM_HALF_SUB_COUNT;
+
+  return CYCLE_HISTOGRAM_SUB_COUNT + (shift - 1) * CYCLE_HISTOGRAM_HALF_SUB_COUNT + sub;
+}
+
+/**
+ * Largest value that falls into the bucket, i.e. reported percentiles are
+ * never lower than the recorded values.
+ */
+inline int64_t cycle_histogram_value(int index)
+{
+  if (index < CYCLE_HISTOGRAM_SUB_COUNT)
+  {
+    return index;
+  }
+
+  int k = index - CYCLE_HISTOGRAM_SUB_COUNT;
+  int shift = k / CYCLE_HISTOGRAM_HALF_SUB_COUNT + 1;
+  int64_t sub = k % CYCLE_HISTOGRAM_HALF_SUB_COUNT + CYCLE_HISTOGRAM_HALF_SUB_COUNT;
+
+  return ((sub + 1) << shift) - 1;
+}
+
+inline void record_cycle_histogram(CycleHistogram *histogram, int64_t value)
+{
+  histogram->counts[cycle_histogram_index(value)]++;
+  histogram->total++;
+  if (value < histogram->min)
+  {
+    histogram->min = value;
+  }
+  if (value > histogram->max)
+  {
+    histogram->max = value;
+  }
+}
+
+/**
+ * @param percentile in [0, 100]
+ */
+inline int64_t cycle_histogram_percentile(const CycleHistogram *histogram, double percentile)
+{
+  if (histogram->total == 0)
+  {
+    return 0;
+  }
+
+  uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->total + 0.5);
+  if (rank < 1)
+  {
+    rank = 1;
+  }
+
+  uint64_t count = 0;
+  for (int i = 0; i < CYCLE_HISTOGRAM_SIZE; i++)
+  {
+    count += histogram->counts[i];
+    if (count >= rank)
+    {
+      int64_t value = cycle_histogram_value(i);
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+
+  return histogram->max;
+}
+
+/**
+ * Period, compute time and slack of every cycle of the control loop.
+ */
+struct CycleTimingStats
+{
+  CycleHistogram period;
+  CycleHistogram compute;
+  CycleHistogram slack;
+  long overruns;
+};
+
+inline void initialize_cycle_timing_stats(CycleTimingStats *stats)
+{
+  initialize_cycle_histogram(&stats->period);
+  initialize_cycle_histogram(&stats->compute);
+  initialize_cycle_histogram(&stats->slack);
+  stats->overruns = 0;
+}
+
+/**
+ * Records the last cycle of the scheduler, to be called right after
+ * cycle_scheduler_wait.
+ */
+inline void record_cycle_timing(CycleTimingStats *stats, const CycleScheduler *scheduler)
+{
+  // the first release has no previous one to measure the period against
+  if (scheduler->cycles > 1)
+  {
+    record_cycle_histogram(&stats->period, scheduler->last_period_ns);
+  }
+  record_cycle_histogram(&stats->compute, scheduler->last_compute_ns);
+
+  if (scheduler->last_slack_ns < 0)
+  {
+    stats->overruns++;
+  }
+  record_cycle_histogram(&stats->slack, scheduler->last_slack_ns < 0 ? 0 : scheduler->last_slack_ns);
+}
+
+/**
+ * Records one cycle of a loop that keeps its own time instead of running on a
+ * CycleScheduler. A negative slack counts as an overrun.
+ */
+inline void record_cycle_timing_sample(CycleTimingStats *stats, int64_t period_ns,
+                                       int64_t compute_ns, int64_t slack_ns)
+{
+  record_cycle_histogram(&stats->period, period_ns);
+  record_cycle_histogram(&stats->compute, compute_ns);
+
+  if (slack_ns < 0)
+  {
+    stats->overruns++;
+  }
+  record_cycle_histogram(&stats->slack, slack_ns < 0 ? 0 : slack_ns);
+}
+
+inline void print_cycle_histogram_summary(FILE *file, const char *name,
+                                          const CycleHistogram *histogram)
+{
+  fprintf(file, "%-8s [us] min: %9.3f  p50: %9.3f  p99: %9.3f  p99.9: %9.3f  max: %9.3f\n", name,
+          (histogram->total ? histogram->min : 0) / 1e3,
+          cycle_histogram_percentile(histogram, 50.0) / 1e3,
+          cycle_histogram_percentile(histogram, 99.0) / 1e3,
+          cycle_histogram_percentile(histogram, 99.9) / 1e3, histogram->max / 1e3);
+}
+
+inline void print_cycle_timing_report(FILE *file, const CycleTimingStats *stats)
+{
+  fprintf(file, "cycles: %lu, overruns: %ld\n", (unsigned long)stats->compute.total,
+          stats->overruns);
+  print_cycle_histogram_summary(file, "period", &stats->period);
+  print_cycle_histogram_summary(file, "compute", &stats->compute);
+  print_cycle_histogram_summary(file, "slack", &stats->slack);
+}
+
+/**
+ * Writes the summary to <log_dir>/cycle_timing.txt and the non-empty buckets
+ * of the histograms to <log_dir>/cycle_timing_histogram.csv.
+ */
+inline void write_cycle_timing_report(const CycleTimingStats *stats, const char *log_dir)
+{
+  std::string summary_file = std::string(log_dir) + "/cycle_timing.txt";
+  FILE *file = fopen(summary_file.c_str(), "w");
+  if (file != NULL)
+  {
+    print_cycle_timing_report(file, stats);
+    fclose(file);
+  }
+
+  std::string histogram_file = std::string(log_dir) + "/cycle_timing_histogram.csv";
+  file = fopen(histogram_file.c_str(), "w");
+  if (file != NULL)
+  {
+    fprintf(file, "value_ns,period,compute,slack\n");
+    for (int i = 0; i < CYCLE_HISTOGRAM_SIZE; i++)
+    {
+      if (stats->period.counts[i] == 0 && stats->compute.counts[i] == 0 &&
+          stats->slack.counts[i] == 0)
+      {
+        continue;
+      }
+      fprintf(file, "%ld,%lu,%lu,%lu\n", (long)cycle_histogram_value(i),
+              (unsigned long)stats->period.counts[i], (unsigned long)stats->compute.counts[i],
+              (unsigned long)stats->slack.counts[i]);
+    }
+    fclose(file);
+  }
+}
+
+#endif  // CYCLE_HISTOGRAM_HPP
@@ -0,0 +1,194 @@
+#ifndef CYCLE_SCHEDULER_HPP
+#define CYCLE_SCHEDULER_HPP
+
+#include <time.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+
+constexpr int64_t NS_PER_SECOND = 1000000000LL;
+
+/**
+ * Periodic scheduler for the control loop.
+ *
+ * Every cycle is released at an absolute deadline on CLOCK_MONOTONIC, so the
+ * phase of the loop is fixed to the instant the scheduler was started and an
+ * overrun does not shift all following cycles. The thread sleeps with
+ * clock_nanosleep(TIMER_ABSTIME) until `spin_ns` before the deadline and then
+ * spins for the remainder to absorb the wake-up latency of the kernel.
+ */
+struct CycleScheduler
+{
+  int64_t period_ns;
+  int64_t spin_ns;
+
+  int64_t next_release_ns;  // absolute deadline of the next cycle
+  int64_t last_release_ns;  // instant the current cycle was released
+  int64_t cycle_start_ns;   // instant the current cycle started executing
+
+  bool started;
+
+  // timing of the last completed cycle
+  int64_t last_period_ns;   // between the previous and the last release
+  int64_t last_compute_ns;  // from cycle_scheduler_begin to cycle_scheduler_wait
+  int64_t last_slack_ns;    // from the end of the computation to the deadline, < 0 on overrun
+
+  // statistics
+  long cycles;
+  long overruns;         // cycles that finished after their deadline
+  long missed_releases;  // releases skipped to re-align with the phase
+  int64_t last_overrun_ns;
+  int64_t max_overrun_ns;
+};
+
+inline int64_t cycle_scheduler_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * NS_PER_SECOND + ts.tv_nsec;
+}
+
+inline void cycle_scheduler_sleep_until(int64_t deadline_ns)
+{
+  struct timespec ts;
+  ts.tv_sec = deadline_ns / NS_PER_SECOND;
+  ts.tv_nsec = deadline_ns % NS_PER_SECOND;
+
+  // restart the sleep if it was interrupted by a signal handler
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+  {
+  }
+}
+
+/**
+ * @param frequency desired frequency of the loop [Hz]
+ * @param spin_duration time before each deadline that is busy-waited instead
+ *                      of slept [s], 0.0 to only sleep
+ */
+inline void initialize_cycle_scheduler(CycleScheduler *scheduler, double frequency,
+                                       double spin_duration = 0.0)
+{
+  scheduler->period_ns = (int64_t)(NS_PER_SECOND / frequency);
+  scheduler->spin_ns = (int64_t)(spin_duration * NS_PER_SECOND);
+  if (scheduler->spin_ns > scheduler->period_ns)
+  {
+    scheduler->spin_ns = scheduler->period_ns;
+  }
+
+  scheduler->next_release_ns = 0;
+  scheduler->last_release_ns = 0;
+  scheduler->cycle_start_ns = 0;
+  scheduler->started = false;
+
+  scheduler->last_period_ns = 0;
+  scheduler->last_compute_ns = 0;
+  scheduler->last_slack_ns = 0;
+
+  scheduler->cycles = 0;
+  scheduler->overruns = 0;
+  scheduler->missed_releases = 0;
+  scheduler->last_overrun_ns = 0;
+  scheduler->max_overrun_ns = 0;
+}
+
+/**
+ * Marks the beginning of a cycle. The first call anchors the phase of the
+ * loop, i.e. all deadlines are multiples of the period from this instant.
+ */
+inline void cycle_scheduler_begin(CycleScheduler *scheduler)
+{
+  scheduler->cycle_start_ns = cycle_scheduler_now_ns();
+
+  if (!scheduler->started)
+  {
+    scheduler->started = true;
+    scheduler->last_release_ns = scheduler->cycle_start_ns;
+    scheduler->next_release_ns = scheduler->cycle_start_ns + scheduler->period_ns;
+  }
+}
+
+/**
+ * Anchors the phase of the loop to a clock shared with other processes
+ * instead of the first cycle: sleeps until the next release at
+ * epoch_ns + k * period, which becomes the release of the first cycle. Loops
+ * aligned to the same epoch and period are released at the same instants.
+ * To be called before the first cycle_scheduler_begin.
+ */
+inline void cycle_scheduler_align(CycleScheduler *scheduler, int64_t epoch_ns)
+{
+  int64_t now = cycle_scheduler_now_ns();
+  int64_t release = epoch_ns;
+  if (now > epoch_ns)
+  {
+    release += ((now - epoch_ns) / scheduler->period_ns + 1) * scheduler->period_ns;
+  }
+
+  cycle_scheduler_sleep_until(release);
+
+  scheduler->started = true;
+  scheduler->last_release_ns = release;
+  scheduler->next_release_ns = release + scheduler->period_ns;
+}
+
+/**
+ * Blocks until the deadline of the current cycle.
+ *
+ * If the cycle overran, the deadline is moved forward by whole periods so the
+ * next cycle is released on the original phase grid instead of immediately.
+ *
+ * @return time between the previous and the new release [s], to be used as
+ *         the control loop time step
+ */
+inline double cycle_scheduler_wait(CycleScheduler *scheduler)
+{
+  int64_t now = cycle_scheduler_now_ns();
+
+  scheduler->cycles++;
+  scheduler->last_compute_ns = now - scheduler->cycle_start_ns;
+  scheduler->last_slack_ns = scheduler->next_release_ns - now;
+
+  if (now > scheduler->next_release_ns)
+  {
+    int64_t overrun = now - scheduler->next_release_ns;
+    int64_t missed = overrun / scheduler->period_ns + 1;
+
+    scheduler->overruns++;
+    scheduler->missed_releases += missed - 1;
+    scheduler->last_overrun_ns = overrun;
+    if (overrun > scheduler->max_overrun_ns)
+    {
+      scheduler->max_overrun_ns = overrun;
+    }
+
+    scheduler->next_release_ns += missed * scheduler->period_ns;
+  }
+
+  int64_t deadline = scheduler->next_release_ns;
+
+  if (deadline - scheduler->spin_ns > now)
+  {
+    cycle_scheduler_sleep_until(deadline - scheduler->spin_ns);
+  }
+
+  do
+  {
+    now = cycle_scheduler_now_ns();
+  } while (now < deadline);
+
+  scheduler->last_period_ns = now - scheduler->last_release_ns;
+  double timestep = (double)scheduler->last_period_ns / NS_PER_SECOND;
+
+  scheduler->last_release_ns = now;
+  scheduler->next_release_ns = deadline + scheduler->period_ns;
+
+  return timestep;
+}
+
+inline void print_cycle_scheduler_report(const CycleScheduler *scheduler)
+{
+  printf("cycles: %ld, overruns: %ld, missed releases: %ld, max overrun: %.3f ms\n",
+         scheduler->cycles, scheduler->overruns, scheduler->missed_releases,
+         (double)scheduler->max_overrun_ns / 1e6);
+}
+
+#endif  // CYCLE_SCHEDULER_HPP
@@ -0,0 +1,57 @@
+#ifndef DELAY_COMPENSATION_HPP
+#define DELAY_COMPENSATION_HPP
+
+// largest error of a pid controller, in elements
+#define DELAY_COMPENSATION_MAX_SIZE 6
+
+/**
+ * Error of a pid controller predicted to the instant its command takes
+ * effect.
+ *
+ * The pipelined loop sends the commands computed from the samples of a cycle
+ * actuation_delay_cycles later. The controller then acts on its error
+ * extrapolated linearly over that delay from the last two measured errors,
+ * instead of on an error that is that much older than its command.
+ */
+struct DelayCompensation
+{
+  double delay;  // s
+  double last_error[DELAY_COMPENSATION_MAX_SIZE];  // measured, not predicted
+  bool primed;  // false until the first error was measured
+};
+
+/**
+ * @param delay time from the samples to the actuation of the commands
+ *              computed from them [s]
+ */
+inline void initialize_delay_compensation(DelayCompensation *compensation, double delay)
+{
+  compensation->delay = delay;
+  for (int i = 0; i < DELAY_COMPENSATION_MAX_SIZE; i++)
+  {
+    compensation->last_error[i] = 0.0;
+  }
+  compensation->primed = false;
+}
+
+/**
+ * Replaces the measured `error` by its prediction, to be called between the
+ * error computation and the pid controller.
+ *
+ * @param dt time since the last error of the controller [s]
+ */
+inline void compensate_delay(DelayCompensation *compensation, double *error, int size, double dt)
+{
+  for (int i = 0; i < size; i++)
+  {
+    double measured = error[i];
+    if (compensation->primed && dt > 0.0)
+    {
+      error[i] += (measured - compensation->last_error[i]) * compensation->delay / dt;
+    }
+    compensation->last_error[i] = measured;
+  }
+  compensation->primed = true;
+}
+
+#endif  // DELAY_COMPENSATION_HPP
@@ -0,0 +1,86 @@
+#ifndef ETHERCAT_BACKEND_HPP
+#define ETHERCAT_BACKEND_HPP
+
+#include <robif2b/functions/ethercat.h>
+
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+#include "virtual_kelo_ethercat.hpp"
+#endif
+
+/**
+ * EtherCAT of the Kelo base, either robif2b on the real segment or, built with
+ * -DVIRTUAL_ETHERCAT=ON, virtual Kelo drives on a simulated platform
+ * (virtual_kelo_ethercat.hpp). Both exchange the same robif2b_kelo_drive_api
+ * PDOs through the robif2b_ethercat struct, so the robif2b encoder, imu and
+ * actuator functions of the loops work unchanged.
+ */
+
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+inline VirtualKeloEthercat virtual_ethercat;
+#endif
+
+/**
+ * Describes the platform to simulate, ignored on the real fieldbus. To be
+ * called before ethercat_backend_configure.
+ *
+ * @param pivot_positions x, y of each pivot [m]
+ * @param pivot_offsets offsets of the pivot encoders [rad]
+ */
+inline void ethercat_backend_set_platform(int num_drives, const double *pivot_positions,
+                                          const double *pivot_offsets, double wheel_radius,
+                                          double castor_offset, double half_wheel_distance)
+{
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+  initialize_virtual_kelo_platform(&virtual_ethercat.platform, num_drives, pivot_positions,
+                                   pivot_offsets, wheel_radius, castor_offset,
+                                   half_wheel_distance);
+  virtual_ethercat.platform.exchange_ns = MOTION_SPEC_VIRTUAL_ETHERCAT_EXCHANGE_NS;
+#endif
+}
+
+inline void ethercat_backend_configure(struct robif2b_ethercat *ecat)
+{
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+  virtual_kelo_ethercat_configure(&virtual_ethercat, ecat);
+#else
+  robif2b_ethercat_configure(ecat);
+#endif
+}
+
+inline void ethercat_backend_start(struct robif2b_ethercat *ecat)
+{
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+  virtual_kelo_ethercat_start(&virtual_ethercat);
+#else
+  robif2b_ethercat_start(ecat);
+#endif
+}
+
+inline void ethercat_backend_update(struct robif2b_ethercat *ecat)
+{
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+  virtual_kelo_ethercat_update(&virtual_ethercat);
+#else
+  robif2b_ethercat_update(ecat);
+#endif
+}
+
+inline void ethercat_backend_stop(struct robif2b_ethercat *ecat)
+{
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+  virtual_kelo_ethercat_stop(&virtual_ethercat);
+#else
+  robif2b_ethercat_stop(ecat);
+#endif
+}
+
+inline void ethercat_backend_shutdown(struct robif2b_ethercat *ecat)
+{
+#ifdef MOTION_SPEC_VIRTUAL_ETHERCAT
+  virtual_kelo_ethercat_shutdown(&virtual_ethercat);
+#else
+  robif2b_ethercat_shutdown(ecat);
+#endif
+}
+
+#endif  // ETHERCAT_BACKEND_HPP
@@ -0,0 +1,179 @@
+#ifndef FIELDBUS_THREAD_HPP
+#define FIELDBUS_THREAD_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+#include "cycle_histogram.hpp"
+#include "cycle_scheduler.hpp"
+
+// age in periods of the fieldbus after which the last command of the control
+// loop is no longer applied, see fieldbus_command_expired
+#define FIELDBUS_COMMAND_TIMEOUT_PERIODS 10
+
+/**
+ * Periodic thread that owns the process data exchange of a fieldbus, e.g. the
+ * EtherCAT of the Kelo drives.
+ *
+ * The exchange runs at its own rate on its own cpu, decoupled from the control
+ * loop. Measurements and commands are handed over through triple buffers
+ * (triple_buffer.hpp) by the exchange job, so the control thread never waits
+ * for the fieldbus. The thread stops itself once the job fails.
+ *
+ * The fieldbus keeps exchanging while the control loop stalls, so the job
+ * must not apply a command forever: with fieldbus_command_expired it drops
+ * commands older than FIELDBUS_COMMAND_TIMEOUT_PERIODS, as the watchdog of
+ * the drives did when the control thread still ran the exchange.
+ */
+struct FieldbusThread
+{
+  const char *name;
+  std::function<bool()> exchange;  // false on a fieldbus error
+  int cpu;                         // -1 to not pin
+
+  CycleScheduler scheduler;
+  pthread_t thread;
+
+  std::atomic<bool> run;
+  std::atomic<bool> failed;
+  std::atomic<long> exchanges;
+
+  int64_t command_timeout_ns;
+
+  // statistics, only written by the thread
+  CycleTimingStats timing;
+  bool command_expired;
+  long expired_exchanges;  // exchanges without a command of the control loop
+  long expirations;        // times the command of the control loop expired
+};
+
+inline void *fieldbus_thread_run(void *arg)
+{
+  FieldbusThread *fieldbus = (FieldbusThread *)arg;
+
+  if (fieldbus->cpu >= 0)
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(fieldbus->cpu, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+    {
+      printf("Failed to pin the %s thread to cpu %d\n", fieldbus->name, fieldbus->cpu);
+    }
+  }
+
+  while (fieldbus->run.load(std::memory_order_relaxed))
+  {
+    cycle_scheduler_begin(&fieldbus->scheduler);
+
+    if (!fieldbus->exchange())
+    {
+      printf("%s exchange failed, stopping its thread\n", fieldbus->name);
+      fieldbus->failed.store(true, std::memory_order_release);
+      break;
+    }
+    fieldbus->exchanges.fetch_add(1, std::memory_order_release);
+
+    cycle_scheduler_wait(&fieldbus->scheduler);
+    record_cycle_timing(&fieldbus->timing, &fieldbus->scheduler);
+  }
+
+  return NULL;
+}
+
+/**
+ * Starts the thread, after the fieldbus is configured and started. It
+ * inherits the scheduling policy of the calling thread.
+ *
+ * @param frequency rate of the exchange [Hz], independent of the control loop
+ * @param cpu cpu the thread is pinned to, -1 to not pin
+ */
+inline void start_fieldbus_thread(FieldbusThread *fieldbus, const char *name, double frequency,
+                                  int cpu, std::function<bool()> exchange)
+{
+  fieldbus->name = name;
+  fieldbus->exchange = exchange;
+  fieldbus->cpu = cpu;
+  initialize_cycle_scheduler(&fieldbus->scheduler, frequency, 50e-6);
+  initialize_cycle_timing_stats(&fieldbus->timing);
+  fieldbus->command_timeout_ns = FIELDBUS_COMMAND_TIMEOUT_PERIODS * fieldbus->scheduler.period_ns;
+  fieldbus->command_expired = false;
+  fieldbus->expired_exchanges = 0;
+  fieldbus->expirations = 0;
+
+  fieldbus->run.store(true);
+  fieldbus->failed.store(false);
+  fieldbus->exchanges.store(0);
+
+  if (pthread_create(&fieldbus->thread, NULL, fieldbus_thread_run, fieldbus) != 0)
+  {
+    perror("pthread_create");
+    exit(1);
+  }
+}
+
+/**
+ * Waits for the first exchange, so the first measurements are available.
+ *
+ * @return false if it failed
+ */
+inline bool wait_fieldbus_thread_started(FieldbusThread *fieldbus)
+{
+  while (fieldbus->exchanges.load(std::memory_order_acquire) == 0)
+  {
+    if (fieldbus->failed.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    sched_yield();
+  }
+  return true;
+}
+
+/**
+ * To be called by the exchange job with the stamp of the last command of the
+ * control loop (cycle_scheduler_now_ns when it was published).
+ *
+ * @return true if the command is older than the timeout, the job must then
+ *         send a safe command, e.g. zero torques, instead of it
+ */
+inline bool fieldbus_command_expired(FieldbusThread *fieldbus, int64_t stamp_ns)
+{
+  bool expired = cycle_scheduler_now_ns() - stamp_ns > fieldbus->command_timeout_ns;
+  if (expired)
+  {
+    fieldbus->expired_exchanges++;
+    if (!fieldbus->command_expired)
+    {
+      fieldbus->expirations++;
+    }
+  }
+  fieldbus->command_expired = expired;
+  return expired;
+}
+
+inline bool fieldbus_thread_failed(const FieldbusThread *fieldbus)
+{
+  return fieldbus->failed.load(std::memory_order_acquire);
+}
+
+inline void stop_fieldbus_thread(FieldbusThread *fieldbus)
+{
+  fieldbus->run.store(false);
+  pthread_join(fieldbus->thread, NULL);
+}
+
+inline void print_fieldbus_thread_report(FILE *file, const FieldbusThread *fieldbus)
+{
+  fprintf(file, "%s thread at %.1f Hz, exchanges: %ld\n", fieldbus->name,
+          (double)NS_PER_SECOND / fieldbus->scheduler.period_ns, fieldbus->exchanges.load());
+  print_cycle_timing_report(file, &fieldbus->timing);
+  fprintf(file, "expired commands: %ld times, %ld exchanges (timeout %.1f ms)\n",
+          fieldbus->expirations, fieldbus->expired_exchanges, fieldbus->command_timeout_ns / 1e6);
+}
+
+#endif  // FIELDBUS_THREAD_HPP
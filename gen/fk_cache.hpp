@@ -0,0 +1,386 @@
+#ifndef FK_CACHE_HPP
+#define FK_CACHE_HPP
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/tree.hpp>
+#include <kdl_parser/kdl_parser.hpp>
+#include <motion_spec_utils/utils.hpp>
+
+#define FK_CACHE_MAX_LINKS 64
+#define FK_CACHE_MAX_CHAINS 2
+#define FK_CACHE_ROOT "base_link"
+
+/**
+ * Poses of all links of the Kinova chains w.r.t. the base, computed once per
+ * cycle after get_robot_data instead of by every primitive that needs one.
+ *
+ * Without the cache, every getLinkPosition, getLinkQuaternion,
+ * computeDistance, decomposeSignal, transform_wrench and transform_alpha walks
+ * the chains to the links it names, so the same bracelet pose is computed
+ * several times per cycle. update_fk_cache walks every chain once, and the
+ * fk_cache_* primitives below read the poses it stored.
+ *
+ * The links are resolved by name to dense IDs once, with fk_cache_link_id,
+ * with the short kl_ and kr_ names of the specs as aliases of the
+ * kinova_left_ and kinova_right_ links. The primitives take the IDs, so the
+ * loop does not hash, compare or construct strings. Frames of the
+ * primitives are coordinate frames only: re-expressing a vector, wrench or
+ * constraint direction rotates it, the point it refers to is unchanged.
+ *
+ * The links before the first joint of a chain are rigid w.r.t. the root,
+ * their poses are computed once at initialization.
+ */
+struct FkCacheChain
+{
+  KDL::Chain chain;     // FK_CACHE_ROOT to the tool frame of the arm
+  const double *q;      // joint positions of the arm, ManipulatorState::q
+  int first_link;       // cache index of the first segment of the chain
+  bool swept;           // poses written by the sweep of its arm instead, see achd_sweep.hpp
+};
+
+struct FkCache
+{
+  KDL::Frame frames[FK_CACHE_MAX_LINKS];  // w.r.t. FK_CACHE_ROOT, index 0 is the root
+  bool rigid[FK_CACHE_MAX_LINKS];         // pose independent of the joint positions
+  int num_links;
+
+  FkCacheChain chains[FK_CACHE_MAX_CHAINS];
+  int num_chains;
+
+  std::unordered_map<std::string, int> links;  // link names and aliases to indices
+
+  // statistics
+  long cycles;
+  long chain_evaluations;  // walks along a chain, one per chain and cycle
+  long lookups;            // poses read by the primitives, one FK evaluation each uncached
+};
+
+inline void add_fk_cache_link(FkCache *cache, const std::string &name, int index)
+{
+  static const char *aliases[][2] = {
+      {"kinova_left_", "kl_"},
+      {"kinova_right_", "kr_"},
+  };
+
+  cache->links.emplace(name, index);
+  for (const auto &alias : aliases)
+  {
+    if (name.compare(0, std::string(alias[0]).size(), alias[0]) == 0)
+    {
+      cache->links.emplace(alias[1] + name.substr(std::string(alias[0]).size()), index);
+    }
+  }
+}
+
+inline bool add_fk_cache_chain(FkCache *cache, const KDL::Tree &tree,
+                               const std::string &tool_frame, const double *q)
+{
+  if (cache->num_chains >= FK_CACHE_MAX_CHAINS)
+  {
+    printf("Too many chains for the FK cache, not adding %s\n", tool_frame.c_str());
+    return false;
+  }
+
+  FkCacheChain *chain = &cache->chains[cache->num_chains];
+  if (!tree.getChain(FK_CACHE_ROOT, tool_frame, chain->chain))
+  {
+    printf("No chain from %s to %s for the FK cache\n", FK_CACHE_ROOT, tool_frame.c_str());
+    return false;
+  }
+
+  int num_segments = chain->chain.getNrOfSegments();
+  if (cache->num_links + num_segments > FK_CACHE_MAX_LINKS)
+  {
+    printf("Too many links for the FK cache, not adding %s\n", tool_frame.c_str());
+    return false;
+  }
+
+  chain->q = q;
+  chain->first_link = cache->num_links;
+  chain->swept = false;
+
+  KDL::Frame pose = KDL::Frame::Identity();
+  bool rigid = true;
+  for (int i = 0; i < num_segments; i++)
+  {
+    const KDL::Segment &segment = chain->chain.getSegment(i);
+    rigid = rigid && segment.getJoint().getType() == KDL::Joint::None;
+    if (rigid)
+    {
+      pose = pose * segment.pose(0.0);
+      cache->frames[cache->num_links] = pose;
+    }
+    cache->rigid[cache->num_links] = rigid;
+    add_fk_cache_link(cache, segment.getName(), cache->num_links++);
+  }
+
+  cache->num_chains++;
+  return true;
+}
+
+/**
+ * @param urdf the urdf the robot was initialized from
+ * @param robot robot whose Manipulator states hold the joint positions the
+ *              cache is updated from, they must not be reallocated
+ */
+inline bool initialize_fk_cache(FkCache *cache, const std::string &urdf, Freddy *robot)
+{
+  cache->num_links = 1;
+  cache->num_chains = 0;
+  cache->links.clear();
+  cache->frames[0] = KDL::Frame::Identity();
+  cache->rigid[0] = true;
+  add_fk_cache_link(cache, FK_CACHE_ROOT, 0);
+
+  cache->cycles = 0;
+  cache->chain_evaluations = 0;
+  cache->lookups = 0;
+
+  KDL::Tree tree;
+  if (!kdl_parser::treeFromFile(urdf, tree))
+  {
+    printf("Failed to load %s for the FK cache\n", urdf.c_str());
+    return false;
+  }
+
+  return add_fk_cache_chain(cache, tree, robot->kinova_left->tool_frame,
+                            robot->kinova_left->state->q) &&
+         add_fk_cache_chain(cache, tree, robot->kinova_right->tool_frame,
+                            robot->kinova_right->state->q);
+}
+
+/**
+ * Computes the poses of all links from the joint positions of the robot, to
+ * be called once per cycle after get_robot_data.
+ */
+inline void update_fk_cache(FkCache *cache)
+{
+  for (int c = 0; c < cache->num_chains; c++)
+  {
+    const FkCacheChain *chain = &cache->chains[c];
+    if (chain->swept)
+    {
+      continue;
+    }
+
+    KDL::Frame pose = KDL::Frame::Identity();
+    int joint = 0;
+
+    for (int i = 0; i < (int)chain->chain.getNrOfSegments(); i++)
+    {
+      const KDL::Segment &segment = chain->chain.getSegment(i);
+      if (segment.getJoint().getType() == KDL::Joint::None)
+      {
+        pose = pose * segment.pose(0.0);
+      }
+      else
+      {
+        pose = pose * segment.pose(chain->q[joint++]);
+      }
+      cache->frames[chain->first_link + i] = pose;
+    }
+    cache->chain_evaluations++;
+  }
+
+  cache->cycles++;
+}
+
+/**
+ * Dense ID of a link, its index in the cache, to be resolved once at
+ * initialization so that the loop passes IDs instead of names to the
+ * primitives below. Exits if the link is not in the cache.
+ */
+inline int fk_cache_link_id(const FkCache *cache, const std::string &link)
+{
+  auto entry = cache->links.find(link);
+  if (entry == cache->links.end())
+  {
+    printf("Link %s is not in the FK cache\n", link.c_str());
+    exit(1);
+  }
+
+  return entry->second;
+}
+
+/**
+ * Pose of a link w.r.t. FK_CACHE_ROOT as of the last update_fk_cache.
+ */
+inline const KDL::Frame &fk_cache_frame(FkCache *cache, int link)
+{
+  cache->lookups++;
+  return cache->frames[link];
+}
+
+/**
+ * As getLinkPosition: the origin of `entity` w.r.t. the origin of `wrt`,
+ * expressed in `asb`, projected on the linear part of `vector`.
+ */
+inline void fk_cache_link_position(FkCache *cache, int entity, int asb, int wrt,
+                                   const double *vector, double &position)
+{
+  KDL::Vector p = fk_cache_frame(cache, asb).M.Inverse() *
+                  (fk_cache_frame(cache, entity).p - fk_cache_frame(cache, wrt).p);
+  position = p.x() * vector[0] + p.y() * vector[1] + p.z() * vector[2];
+}
+
+/**
+ * As getLinkQuaternion: the orientation of `entity` expressed in `asb`, as
+ * x, y, z, w. `wrt` is a point and does not change an orientation.
+ */
+inline void fk_cache_link_quaternion(FkCache *cache, int entity, int asb, int wrt,
+                                     double *quaternion)
+{
+  KDL::Rotation rotation =
+      fk_cache_frame(cache, asb).M.Inverse() * fk_cache_frame(cache, entity).M;
+  rotation.GetQuaternion(quaternion[0], quaternion[1], quaternion[2], quaternion[3]);
+}
+
+/**
+ * As computeDistance: the distance between the origins of two links.
+ */
+inline void fk_cache_distance(FkCache *cache, int entity, int other_entity, double &distance)
+{
+  distance = (fk_cache_frame(cache, entity).p - fk_cache_frame(cache, other_entity).p).Norm();
+}
+
+/**
+ * As computeDistance1D: the origin of `entity` w.r.t. the origin of
+ * `other_entity`, expressed in `asb`, projected on `axis`.
+ */
+inline void fk_cache_distance_1d(FkCache *cache, int entity, int other_entity,
+                                 const double *axis, int asb, double &distance)
+{
+  KDL::Vector d = fk_cache_frame(cache, asb).M.Inverse() *
+                  (fk_cache_frame(cache, entity).p - fk_cache_frame(cache, other_entity).p);
+  distance = d.x() * axis[0] + d.y() * axis[1] + d.z() * axis[2];
+}
+
+/**
+ * As decomposeSignal: `signal` along the unit vector from the origin of
+ * `from` to the origin of `to`, expressed in `asb`, added to the linear part
+ * of `output`.
+ */
+inline void fk_cache_decompose_signal(FkCache *cache, int from, int to, int asb, double signal,
+                                      double *output)
+{
+  KDL::Vector d = fk_cache_frame(cache, asb).M.Inverse() *
+                  (fk_cache_frame(cache, to).p - fk_cache_frame(cache, from).p);
+  double norm = d.Norm();
+  if (norm == 0.0)
+  {
+    return;
+  }
+
+  output[0] += signal * d.x() / norm;
+  output[1] += signal * d.y() / norm;
+  output[2] += signal * d.z() / norm;
+}
+
+/**
+ * Rotation re-expressing coordinates in `from` in `to`.
+ */
+inline KDL::Rotation fk_cache_rotation(FkCache *cache, int from, int to)
+{
+  return fk_cache_frame(cache, to).M.Inverse() * fk_cache_frame(cache, from).M;
+}
+
+inline void rotate_screw(const KDL::Rotation &rotation, const double *screw, double *rotated)
+{
+  KDL::Vector linear = rotation * KDL::Vector(screw[0], screw[1], screw[2]);
+  KDL::Vector angular = rotation * KDL::Vector(screw[3], screw[4], screw[5]);
+  rotated[0] = linear.x();
+  rotated[1] = linear.y();
+  rotated[2] = linear.z();
+  rotated[3] = angular.x();
+  rotated[4] = angular.y();
+  rotated[5] = angular.z();
+}
+
+/**
+ * As transform_wrench: a wrench (force, moment) expressed in `from`,
+ * re-expressed in `to`.
+ */
+inline void fk_cache_transform_wrench(FkCache *cache, int from, int to, const double *wrench,
+                                      double *transformed)
+{
+  rotate_screw(fk_cache_rotation(cache, from, to), wrench, transformed);
+}
+
+/**
+ * Whether the relative pose of two links is independent of the joint
+ * positions, so that transforms between them can be computed once.
+ */
+inline bool fk_cache_rigid(const FkCache *cache, int link, int other_link)
+{
+  return cache->rigid[link] && cache->rigid[other_link];
+}
+
+/**
+ * transformed[i] = diag(R, R) screws[i] for the `n` screws (linear, angular),
+ * the adjoint of `rotation` applied to the whole batch. Built for AVX2 and
+ * FMA (AVX2_KERNELS in CMakeLists.txt), every screw takes six vector
+ * multiply-adds with the columns of R, else it is rotated as by
+ * rotate_screw.
+ */
+inline void fk_cache_transform_screws(const KDL::Rotation &rotation, double *const *screws, int n,
+                                      double **transformed)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+  const double *R = rotation.data;
+  const __m256d x = _mm256_setr_pd(R[0], R[3], R[6], 0.0);
+  const __m256d y = _mm256_setr_pd(R[1], R[4], R[7], 0.0);
+  const __m256d z = _mm256_setr_pd(R[2], R[5], R[8], 0.0);
+  const __m256i first_three = _mm256_setr_epi64x(-1, -1, -1, 0);
+
+  for (int i = 0; i < n; i++)
+  {
+    const double *screw = screws[i];
+    __m256d linear = _mm256_mul_pd(x, _mm256_broadcast_sd(screw));
+    __m256d angular = _mm256_mul_pd(x, _mm256_broadcast_sd(screw + 3));
+    linear = _mm256_fmadd_pd(y, _mm256_broadcast_sd(screw + 1), linear);
+    angular = _mm256_fmadd_pd(y, _mm256_broadcast_sd(screw + 4), angular);
+    linear = _mm256_fmadd_pd(z, _mm256_broadcast_sd(screw + 2), linear);
+    angular = _mm256_fmadd_pd(z, _mm256_broadcast_sd(screw + 5), angular);
+
+    // the padding lane of the linear part is overwritten by the angular part
+    _mm256_storeu_pd(transformed[i], linear);
+    _mm256_maskstore_pd(transformed[i] + 3, first_three, angular);
+  }
+#else
+  for (int i = 0; i < n; i++)
+  {
+    rotate_screw(rotation, screws[i], transformed[i]);
+  }
+#endif
+}
+
+/**
+ * As transform_alpha: the `nc` constraint directions (linear, angular)
+ * expressed in `from`, re-expressed in `to`, as one batch.
+ */
+inline void fk_cache_transform_alpha(FkCache *cache, int from, int to, double *const *alpha,
+                                     int nc, double **transformed)
+{
+  fk_cache_transform_screws(fk_cache_rotation(cache, from, to), alpha, nc, transformed);
+}
+
+inline void print_fk_cache_report(FILE *file, const FkCache *cache)
+{
+  double cycles = cache->cycles > 0 ? (double)cache->cycles : 1.0;
+  fprintf(file, "fk cache: %d links, %.1f chain evaluations per cycle, %.1f pose lookups per "
+          "cycle (FK evaluations without the cache)\n",
+          cache->num_links, cache->chain_evaluations / cycles, cache->lookups / cycles);
+}
+
+#endif  // FK_CACHE_HPP
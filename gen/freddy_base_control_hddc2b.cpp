@@ -12,6 +12,7 @@
 #include <unsupported/Eigen/MatrixFunctions>
 
 #include "motion_spec_utils/log_structs.hpp"
+#include "cycle_histogram.hpp"
 
 #include <hddc2b/functions/platform.h>
 #include <hddc2b/functions/solver.h>
@@ -212,6 +213,10 @@ int main(int argc, char **argv)
   double control_loop_timestep = desired_period.count();                               // s
   double *control_loop_dt = &control_loop_timestep;                                    // s
 
+  // period, compute time and slack histograms of the loop
+  static CycleTimingStats cycle_timing;
+  initialize_cycle_timing_stats(&cycle_timing);
+
   double plat_clip_force = 20.0;
   double plat_sat_force = 300.0;
 
@@ -241,6 +246,8 @@ int main(int argc, char **argv)
 
     if (flag)
     {
+      print_cycle_timing_report(stdout, &cycle_timing);
+      write_cycle_timing_report(&cycle_timing, log_dir_name);
       wheel_align_log_data_vec.writeToOpenFile();
 
       printf("Exiting somewhat cleanly...\n");
@@ -398,6 +405,7 @@ int main(int argc, char **argv)
 
     auto end_time = std::chrono::high_resolution_clock::now();
     auto elapsed_time = std::chrono::duration<double>(end_time - start_time);
+    auto compute_time = elapsed_time;
 
     // if the elapsed time is less than the desired period, busy wait
     while (elapsed_time < desired_period)
@@ -406,6 +414,9 @@ int main(int argc, char **argv)
       elapsed_time = std::chrono::duration<double>(end_time - start_time);
     }
     control_loop_timestep = elapsed_time.count();
+    record_cycle_timing_sample(&cycle_timing, (int64_t)(elapsed_time.count() * 1e9),
+                               (int64_t)(compute_time.count() * 1e9),
+                               (int64_t)((desired_period - compute_time).count() * 1e9));
     // std::cout << "control loop timestep: " << control_loop_timestep << std::endl;
 
     count++;
@@ -12,6 +12,9 @@
 #include <robif2b/functions/ethercat.h>
 #include <robif2b/functions/kelo_drive.h>
 
+#include "base_state_view.hpp"
+#include "ethercat_backend.hpp"
+
 #include <unsupported/Eigen/MatrixFunctions>
 
 #define NUM_DRIVES 4
@@ -251,12 +254,17 @@ int main(int argc, char **argv)
   double w4_ang_prev_error = 0.0;
   double w4_ang_error_sum = 0.0;
 
+  // platform simulated by the virtual EtherCAT, ignored on the real segment
+  ethercat_backend_set_platform(NUM_DRIVES, wheel_coordinates, state.kelo_msr.pvt_off,
+                                kelo_base_config->radius, kelo_base_config->castor_offset,
+                                kelo_base_config->half_wheel_distance);
+
   // Schedule
-  robif2b_ethercat_configure(&ecat);
+  ethercat_backend_configure(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
 
-  robif2b_ethercat_start(&ecat);
+  ethercat_backend_start(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
   
@@ -264,6 +272,12 @@ int main(int argc, char **argv)
 
   auto pgm_start_time = std::chrono::high_resolution_clock::now();
 
+  // the alignment reads the PDO-decoded measurements in place, the
+  // motion_spec_utils functions that take the robot get a copy in its
+  // MobileBaseState
+  BaseStateView base_state;
+  point_base_state_view(&base_state, &state.kelo_msr, NUM_DRIVES, wheel_coordinates);
+
   int count = 0;
 
   while (true)
@@ -286,27 +300,21 @@ int main(int argc, char **argv)
     // printf("\n");
     printf("count: %d\n", count);
 
-    robif2b_ethercat_update(&ecat);
+    ethercat_backend_update(&ecat);
     if (state.ecat.error_code < 0)
       return -1;
     robif2b_kelo_drive_encoder_update(&drive_enc);
 
-    for (int i = 0; i < 4; ++i) {
-        robot.mobile_base->state->pivot_angles[i] = state.kelo_msr.pvt_pos[i];
-    }
-    for (int i = 0; i < 8; ++i) {
-        robot.mobile_base->state->wheel_encoder_values[i] = state.kelo_msr.whl_pos[i];
-        robot.mobile_base->state->qd_wheel[i] = state.kelo_msr.whl_vel[i];
-    }
+    write_mobile_base_state(&base_state, robot.mobile_base->state);
 
     get_robot_data(&robot, *control_loop_dt);
 
     // solver
     double platform_force[3] = {pf[0], pf[1], pf[2]};  // [N], [N], [Nm]
 
-    double lin_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    double ang_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    get_pivot_alignment_offsets(&robot, platform_force, lin_offsets, ang_offsets);
+    double lin_offsets[NUM_DRIVES];
+    double ang_offsets[NUM_DRIVES];
+    compute_pivot_alignment_offsets(&base_state, platform_force, lin_offsets, ang_offsets);
 
     Eigen::Vector2d lin_pf = Eigen::Vector2d(platform_force[0], platform_force[1]);
 
@@ -404,8 +412,8 @@ int main(int argc, char **argv)
   }
 
   robif2b_kelo_drive_actuator_stop(&wheel_act);
-  robif2b_ethercat_stop(&ecat);
-  robif2b_ethercat_shutdown(&ecat);
+  ethercat_backend_stop(&ecat);
+  ethercat_backend_shutdown(&ecat);
   free_robot_data(&robot);
 
   return 0;
@@ -11,6 +11,7 @@
 #include <csignal>
 
 #include "motion_spec_utils/log_structs.hpp"
+#include "cycle_histogram.hpp"
 
 volatile sig_atomic_t flag = 0;
 
@@ -104,6 +105,10 @@ int main(int argc, char **argv)
   double control_loop_timestep = desired_period.count();                               // s
   double *control_loop_dt = &control_loop_timestep;                                    // s
 
+  // period, compute time and slack histograms of the loop
+  static CycleTimingStats cycle_timing;
+  initialize_cycle_timing_stats(&cycle_timing);
+
   // initialize variables
   double kl_elbow_base_base_distance_z_embed_map_vector[3] = {0.0, 0.0, 1.0};
   double kr_bl_orientation_ang_x_pid_controller_signal = 0.0;
@@ -490,6 +495,8 @@ int main(int argc, char **argv)
 
     if (flag)
     {
+      print_cycle_timing_report(stdout, &cycle_timing);
+      write_cycle_timing_report(&cycle_timing, log_dir_name);
       kr_log_data_vec.writeToOpenFile();
       kl_log_data_vec.writeToOpenFile();
       base_log_data_vec.writeToOpenFile();
@@ -1291,6 +1298,7 @@ int main(int argc, char **argv)
 
     auto end_time = std::chrono::high_resolution_clock::now();
     auto elapsed_time = std::chrono::duration<double>(end_time - start_time);
+    auto compute_time = elapsed_time;
 
     // if the elapsed time is less than the desired period, busy wait
     while (elapsed_time < desired_period)
@@ -1299,6 +1307,9 @@ int main(int argc, char **argv)
       elapsed_time = std::chrono::duration<double>(end_time - start_time);
     }
     control_loop_timestep = elapsed_time.count();
+    record_cycle_timing_sample(&cycle_timing, (int64_t)(elapsed_time.count() * 1e9),
+                               (int64_t)(compute_time.count() * 1e9),
+                               (int64_t)((desired_period - compute_time).count() * 1e9));
     // std::cout << "control loop timestep: " << control_loop_timestep << std::endl;
   }
 
@@ -0,0 +1,218 @@
+#ifndef IO_WORKERS_HPP
+#define IO_WORKERS_HPP
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+#include "cycle_scheduler.hpp"
+#include "rt_setup.hpp"
+
+#define IO_WORKERS_MAX 8
+
+/**
+ * Pre-started threads that run the feedback requests of the robots
+ * concurrently, so a cycle waits for the slowest device instead of the sum
+ * of their round trips.
+ *
+ * Every worker runs one job per request of the control thread. The workers
+ * sleep on a futex in between, the control thread yields while joining so
+ * that the workers can run even if they share its cpu.
+ */
+struct IoWorker
+{
+  const char *name;
+  std::function<void()> job;
+  pthread_t thread;
+
+  std::atomic<uint32_t> requested;  // sequence number of the last request
+  std::atomic<uint32_t> completed;  // sequence number of the last completed job
+  std::atomic<bool> run;
+
+  const RtConfig *rt_config;
+
+  // statistics, only written by the worker
+  int64_t last_ns;
+  int64_t max_ns;
+};
+
+struct IoWorkers
+{
+  IoWorker workers[IO_WORKERS_MAX];
+  int num_workers;
+  uint32_t sequence;
+  const RtConfig *rt_config;
+
+  // statistics of the control thread
+  int64_t last_join_ns;
+  int64_t max_join_ns;
+};
+
+/**
+ * @param rt_config real-time configuration of the process, the workers are
+ *                  pinned to its helper cpus, NULL to keep the affinity
+ */
+inline void initialize_io_workers(IoWorkers *workers, const RtConfig *rt_config)
+{
+  workers->num_workers = 0;
+  workers->sequence = 0;
+  workers->rt_config = rt_config;
+  workers->last_join_ns = 0;
+  workers->max_join_ns = 0;
+}
+
+inline int add_io_worker(IoWorkers *workers, const char *name, std::function<void()> job)
+{
+  if (workers->num_workers >= IO_WORKERS_MAX)
+  {
+    printf("Too many io workers, not adding %s\n", name);
+    return -1;
+  }
+
+  IoWorker *worker = &workers->workers[workers->num_workers];
+  worker->name = name;
+  worker->job = job;
+  worker->requested.store(0);
+  worker->completed.store(0);
+  worker->run.store(true);
+  worker->rt_config = workers->rt_config;
+  worker->last_ns = 0;
+  worker->max_ns = 0;
+
+  return workers->num_workers++;
+}
+
+inline void io_worker_futex_wait(std::atomic<uint32_t> *word, uint32_t value)
+{
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+inline void io_worker_futex_wake(std::atomic<uint32_t> *word)
+{
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+inline void *io_worker_thread(void *arg)
+{
+  IoWorker *worker = (IoWorker *)arg;
+
+  // threads inherit the affinity of the control thread
+  if (worker->rt_config != NULL && set_rt_helper_affinity(worker->rt_config) != 0)
+  {
+    printf("Failed to pin io worker %s to the helper cpus\n", worker->name);
+  }
+
+  uint32_t done = 0;
+  while (true)
+  {
+    uint32_t requested = worker->requested.load(std::memory_order_acquire);
+    while (requested == done && worker->run.load(std::memory_order_relaxed))
+    {
+      io_worker_futex_wait(&worker->requested, done);
+      requested = worker->requested.load(std::memory_order_acquire);
+    }
+
+    if (!worker->run.load(std::memory_order_relaxed))
+    {
+      break;
+    }
+
+    int64_t start_ns = cycle_scheduler_now_ns();
+    worker->job();
+    worker->last_ns = cycle_scheduler_now_ns() - start_ns;
+    if (worker->last_ns > worker->max_ns)
+    {
+      worker->max_ns = worker->last_ns;
+    }
+
+    done = requested;
+    worker->completed.store(done, std::memory_order_release);
+  }
+
+  return NULL;
+}
+
+/**
+ * Starts the threads, after apply_rt_config so that they inherit the
+ * scheduling policy of the control thread.
+ */
+inline void start_io_workers(IoWorkers *workers)
+{
+  for (int i = 0; i < workers->num_workers; i++)
+  {
+    IoWorker *worker = &workers->workers[i];
+    if (pthread_create(&worker->thread, NULL, io_worker_thread, worker) != 0)
+    {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+}
+
+/**
+ * Starts the jobs of all workers for the current cycle.
+ */
+inline void io_workers_request(IoWorkers *workers)
+{
+  workers->sequence++;
+  for (int i = 0; i < workers->num_workers; i++)
+  {
+    IoWorker *worker = &workers->workers[i];
+    worker->requested.store(workers->sequence, std::memory_order_release);
+    io_worker_futex_wake(&worker->requested);
+  }
+}
+
+/**
+ * Waits until the jobs of all workers for the current cycle are done.
+ */
+inline void io_workers_join(IoWorkers *workers)
+{
+  int64_t start_ns = cycle_scheduler_now_ns();
+
+  for (int i = 0; i < workers->num_workers; i++)
+  {
+    IoWorker *worker = &workers->workers[i];
+    while (worker->completed.load(std::memory_order_acquire) != workers->sequence)
+    {
+      sched_yield();
+    }
+  }
+
+  workers->last_join_ns = cycle_scheduler_now_ns() - start_ns;
+  if (workers->last_join_ns > workers->max_join_ns)
+  {
+    workers->max_join_ns = workers->last_join_ns;
+  }
+}
+
+inline void stop_io_workers(IoWorkers *workers)
+{
+  for (int i = 0; i < workers->num_workers; i++)
+  {
+    IoWorker *worker = &workers->workers[i];
+    worker->run.store(false);
+    worker->requested.fetch_add(1, std::memory_order_release);
+    io_worker_futex_wake(&worker->requested);
+    pthread_join(worker->thread, NULL);
+  }
+}
+
+inline void print_io_workers_report(FILE *file, const IoWorkers *workers)
+{
+  for (int i = 0; i < workers->num_workers; i++)
+  {
+    const IoWorker *worker = &workers->workers[i];
+    fprintf(file, "io worker %s max: %.3f us\n", worker->name, worker->max_ns / 1e3);
+  }
+  fprintf(file, "io workers join max: %.3f us\n", workers->max_join_ns / 1e3);
+}
+
+#endif  // IO_WORKERS_HPP
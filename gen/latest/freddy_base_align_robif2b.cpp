@@ -12,6 +12,11 @@
 #include <motion_spec_utils/utils.hpp>
 #include <unsupported/Eigen/MatrixFunctions>
 
+#include "base_state_view.hpp"
+#include "ethercat_backend.hpp"
+#include "fieldbus_thread.hpp"
+#include "triple_buffer.hpp"
+
 #define NUM_DRIVES 4
 #define NUM_SLAVES 8
 
@@ -217,15 +222,69 @@ int main(int argc, char **argv)
     state.kelo_cmd.trq[i * 2 + 1] = 0.0;
   }
 
+  // platform simulated by the virtual EtherCAT, ignored on the real segment
+  ethercat_backend_set_platform(NUM_DRIVES, wheel_coordinates, state.kelo_msr.pvt_off, 0.115 / 2,
+                                0.01, 0.0775 / 2);
+
   // Schedule
-  robif2b_ethercat_configure(&ecat);
+  ethercat_backend_configure(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
 
-  robif2b_ethercat_start(&ecat);
+  ethercat_backend_start(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
 
+  // the EtherCAT thread owns the PDO exchange, the control loop reads the
+  // latest measurements and hands over its torques through triple buffers
+  struct KeloTorqueCmd
+  {
+    double trq[NUM_DRIVES * 2];
+    int64_t stamp_ns;  // published at, for fieldbus_command_expired
+  };
+  static TripleBuffer<decltype(state.kelo_msr)> kelo_msr_buffer;
+  static TripleBuffer<KeloTorqueCmd> kelo_cmd_buffer;
+  initialize_triple_buffer(&kelo_msr_buffer);
+  initialize_triple_buffer(&kelo_cmd_buffer);
+
+  const double ethercat_frequency = 1000.0;  // Hz, independent of the control loop
+  const int ethercat_cpu = 2;                // -1 to not pin
+  static FieldbusThread ethercat_thread;
+  auto ethercat_exchange = [&, cmd_received = false, cmd_stamp_ns = (int64_t)0]() mutable {
+    bool fresh;
+    const KeloTorqueCmd *cmd = triple_buffer_read(&kelo_cmd_buffer, &fresh);
+    if (fresh)
+    {
+      std::copy(cmd->trq, cmd->trq + NUM_DRIVES * 2, state.kelo_cmd.trq);
+      cmd_stamp_ns = cmd->stamp_ns;
+      cmd_received = true;
+    }
+
+    // the drives are only actuated once the control loop sent torques, and
+    // with zero torques while the control loop stalls
+    if (cmd_received)
+    {
+      if (fieldbus_command_expired(&ethercat_thread, cmd_stamp_ns))
+      {
+        std::fill(state.kelo_cmd.trq, state.kelo_cmd.trq + NUM_DRIVES * 2, 0.0);
+      }
+      robif2b_kelo_drive_actuator_update(&wheel_act);
+    }
+
+    ethercat_backend_update(&ecat);
+    if (state.ecat.error_code < 0)
+      return false;
+    robif2b_kelo_drive_encoder_update(&drive_enc);
+
+    *triple_buffer_back(&kelo_msr_buffer) = state.kelo_msr;
+    triple_buffer_publish(&kelo_msr_buffer);
+    return true;
+  };
+  start_fieldbus_thread(&ethercat_thread, "ethercat", ethercat_frequency, ethercat_cpu,
+                        ethercat_exchange);
+  if (!wait_fieldbus_thread_started(&ethercat_thread))
+    return -1;
+
   int count = 0;
 
   while (true)
@@ -235,8 +294,8 @@ int main(int argc, char **argv)
     // if (flag)
     // {
     //   robif2b_kelo_drive_actuator_stop(&wheel_act);
-    //   robif2b_ethercat_stop(&ecat);
-    //   robif2b_ethercat_shutdown(&ecat);
+    //   ethercat_backend_stop(&ecat);
+    //   ethercat_backend_shutdown(&ecat);
     //   free_robot_data(&robot);
     //   printf("Exiting somewhat cleanly...\n");
     //   exit(0);
@@ -246,18 +305,18 @@ int main(int argc, char **argv)
     printf("\n");
     // printf("count: %d\n", count);
 
-    robif2b_ethercat_update(&ecat);
-    if (state.ecat.error_code < 0)
+    // latest measurements of the EtherCAT thread
+    if (fieldbus_thread_failed(&ethercat_thread))
       return -1;
-    robif2b_kelo_drive_encoder_update(&drive_enc);
+    const auto *kelo_msr = triple_buffer_read(&kelo_msr_buffer, NULL);
 
     // for (int i = 0; i < NUM_DRIVES; i++)
     // {
     //   printf(
     //       "drive [id=%i, conn=%i]: "
     //       "w_vel[0]=%5.2f - w_vel[1]=%5.2f - p_pos=%5.2f\n",
-    //       i, state.ecat.is_connected[i + 1], state.kelo_msr.whl_vel[i * 2 + 0],
-    //       state.kelo_msr.whl_vel[i * 2 + 1], state.kelo_msr.pvt_pos[i]);
+    //       i, state.ecat.is_connected[i + 1], kelo_msr->whl_vel[i * 2 + 0],
+    //       kelo_msr->whl_vel[i * 2 + 1], kelo_msr->pvt_pos[i]);
     // }
 
     // solver
@@ -272,41 +331,13 @@ int main(int argc, char **argv)
                                           pow(platform_force[2], 2)));
     platform_weights[1] = 1.0 - platform_weights[0];
 
+    // the pivot angles are read in place from the measurements of the EtherCAT thread
+    BaseStateView base_state;
+    point_base_state_view(&base_state, kelo_msr, NUM_DRIVES, wheel_coordinates);
+
     double lin_offsets[NUM_DRIVES];
     double ang_offsets[NUM_DRIVES];
-
-    Eigen::Rotation2Dd rot_ccw(M_PI / 2);
-    Eigen::Rotation2Dd rot_cw(-M_PI / 2);
-
-    Eigen::Vector2d lin_platform_force;
-    lin_platform_force << platform_force[0], platform_force[1];
-    lin_platform_force.normalize();
-
-    // compute the direction vectors of the pivot links
-    for (size_t i = 0; i < NUM_DRIVES; i++)
-    {
-      double pd_x = cos(state.kelo_msr.pvt_pos[i]);
-      double pd_y = sin(state.kelo_msr.pvt_pos[i]);
-
-      Eigen::Vector2d pivot_dir;
-      pivot_dir << pd_x, pd_y;
-
-      Eigen::Vector2d attachment;
-      attachment << wheel_coordinates[2 * i], wheel_coordinates[2 * i + 1];
-
-      // compute tangent vector of the attachment vector in cw or ccw based on platform force[2] -
-      // moment if the moment is positive, the tangents are in ccw, otherwise in cw
-      Eigen::Vector2d tangent = platform_force[2] > 0 ? rot_ccw * attachment : rot_cw * attachment;
-
-      // get the angular offsets between the pivot direction and the tangent
-      ang_offsets[i] = atan2(pivot_dir.x() * tangent.y() - pivot_dir.y() * tangent.x(),
-                             pivot_dir.x() * tangent.x() + pivot_dir.y() * tangent.y());
-
-      // get the linear offsets between the pivot direction and platform linear force
-      lin_offsets[i] =
-          atan2(pivot_dir.x() * lin_platform_force.y() - pivot_dir.y() * lin_platform_force.x(),
-                pivot_dir.x() * lin_platform_force.x() + pivot_dir.y() * lin_platform_force.y());
-    }
+    compute_pivot_alignment_offsets(&base_state, platform_force, lin_offsets, ang_offsets);
 
     Eigen::Vector2d lin_pf = Eigen::Vector2d(platform_force[0], platform_force[1]);
 
@@ -401,15 +432,17 @@ int main(int argc, char **argv)
       printf("%5.2f ", tau_wheel_c[i]);
     }
 
+    KeloTorqueCmd *kelo_cmd = triple_buffer_back(&kelo_cmd_buffer);
     for (size_t i = 0; i < 4; i++)
     {
-      state.kelo_cmd.trq[2 * i] = -tau_wheel_c[2 * i];
-      state.kelo_cmd.trq[2 * i + 1] = tau_wheel_c[2 * i + 1];
+      kelo_cmd->trq[2 * i] = -tau_wheel_c[2 * i];
+      kelo_cmd->trq[2 * i + 1] = tau_wheel_c[2 * i + 1];
     }
 
     if (count > 1)
     {
-      robif2b_kelo_drive_actuator_update(&wheel_act);
+      kelo_cmd->stamp_ns = cycle_scheduler_now_ns();
+      triple_buffer_publish(&kelo_cmd_buffer);
     }
 
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -425,9 +458,11 @@ int main(int argc, char **argv)
     // std::cout << "control loop timestep: " << control_loop_timestep << std::endl;
   }
 
+  stop_fieldbus_thread(&ethercat_thread);
+  print_fieldbus_thread_report(stdout, &ethercat_thread);
   robif2b_kelo_drive_actuator_stop(&wheel_act);
-  robif2b_ethercat_stop(&ecat);
-  robif2b_ethercat_shutdown(&ecat);
+  ethercat_backend_stop(&ecat);
+  ethercat_backend_shutdown(&ecat);
 
   // free_robot_data(&robot);
 
@@ -11,6 +11,8 @@
 #include <kinova_mediator/mediator.hpp>
 #include <csignal>
 
+#include "base_state_view.hpp"
+
 volatile sig_atomic_t flag = 0;
 
 void handle_signal(int sig)
@@ -942,9 +944,14 @@ int main()
     std::cout << "plat_force: ";
     print_array(plat_force, 3);
 
+    // same alignment as the robif2b loops, here over the state kelo_motion_control fills
+    BaseStateView base_state;
+    point_base_state_view(&base_state, robot.mobile_base->state,
+                          robot.mobile_base->mediator->kelo_base_config);
+
     double lin_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
     double ang_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    get_pivot_alignment_offsets(&robot, plat_force, lin_offsets, ang_offsets);
+    compute_pivot_alignment_offsets(&base_state, plat_force, lin_offsets, ang_offsets);
 
     double base_w1_lin_signal, base_w2_lin_signal, base_w3_lin_signal, base_w4_lin_signal = 0.0;
     double base_w1_ang_signal, base_w2_ang_signal, base_w3_ang_signal, base_w4_ang_signal = 0.0;
@@ -12,6 +12,13 @@
 #include <csignal>
 
 #include "motion_spec_utils/log_structs.hpp"
+#include "cycle_scheduler.hpp"
+#include "cycle_histogram.hpp"
+#include "stage_timer.hpp"
+#include "rt_setup.hpp"
+#include "overrun_policy.hpp"
+#include "sample_clock.hpp"
+#include "io_workers.hpp"
 
 volatile sig_atomic_t flag = 0;
 
@@ -105,6 +112,46 @@ int main(int argc, char **argv)
   double control_loop_timestep = desired_period.count();                               // s
   double *control_loop_dt = &control_loop_timestep;                                    // s
 
+  // sleep until shortly before each deadline, then spin for the remainder
+  const double control_loop_spin_duration = 50e-6;  // s
+  CycleScheduler cycle_scheduler;
+  initialize_cycle_scheduler(&cycle_scheduler, desired_frequency, control_loop_spin_duration);
+
+  // period, compute time and slack histograms of the loop
+  static CycleTimingStats cycle_timing;
+  initialize_cycle_timing_stats(&cycle_timing);
+
+  // degrades the loop under overruns by skipping non-critical parts:
+  //   1: printing and logging
+  //   2: base wheel alignment controllers
+  OverrunPolicy overrun_policy;
+  initialize_overrun_policy(&overrun_policy, &cycle_scheduler, 2, 100, 0.8);
+
+  // acquisition time of the samples of each robot, intervals are clamped to 10 periods
+  SampleClock kinova_left_sample_clock;
+  initialize_sample_clock(&kinova_left_sample_clock, control_loop_timestep,
+                          10.0 * control_loop_timestep);
+  SampleClock kinova_right_sample_clock;
+  initialize_sample_clock(&kinova_right_sample_clock, control_loop_timestep,
+                          10.0 * control_loop_timestep);
+  SampleClock freddy_base_sample_clock;
+  initialize_sample_clock(&freddy_base_sample_clock, control_loop_timestep,
+                          10.0 * control_loop_timestep);
+
+  // per-stage timing probes, compiled in with MOTION_SPEC_STAGE_TIMING
+  STAGE_TIMERS_INIT(stage_timers);
+  STAGE_TIMER_REGISTER(stage_timers, get_robot_data_stage, "get_robot_data");
+  STAGE_TIMER_REGISTER(stage_timers, compute_variables_stage, "compute_variables");
+  STAGE_TIMER_REGISTER(stage_timers, controllers_stage, "controllers");
+  STAGE_TIMER_REGISTER(stage_timers, embed_maps_stage, "embed_maps");
+  STAGE_TIMER_REGISTER(stage_timers, solvers_stage, "solvers");
+  STAGE_TIMER_REGISTER(stage_timers, set_robot_command_torques_stage, "set_robot_command_torques");
+  SOLVER_TIMER_REGISTER(stage_timers, fd_solver_robile_stage, "fd_solver_robile");
+  SOLVER_TIMER_REGISTER(stage_timers, kl_achd_solver_fext_stage, "kl_achd_solver_fext");
+  SOLVER_TIMER_REGISTER(stage_timers, kl_achd_solver_stage, "kl_achd_solver");
+  SOLVER_TIMER_REGISTER(stage_timers, kr_achd_solver_stage, "kr_achd_solver");
+  SOLVER_TIMER_REGISTER(stage_timers, kr_achd_solver_fext_stage, "kr_achd_solver_fext");
+
   // initialize variables
   double kl_elbow_base_base_distance_z_embed_map_vector[3] = {0.0, 0.0, 1.0};
   double kr_bl_orientation_ang_x_pid_controller_signal = 0.0;
@@ -356,6 +403,43 @@ int main(int argc, char **argv)
   LogManipulatorDataVector kl_log_data_vec("kinova_left", log_dir_name, 2);
   LogMobileBaseDataVector base_log_data_vec(log_dir_name, 3);
 
+  // real-time setup of the control thread
+  RtConfig rt_config = {};
+  rt_config.policy = SCHED_FIFO;
+  rt_config.priority = 80;
+  rt_config.control_cpu = 2;
+  rt_config.helper_cpus[0] = 0;
+  rt_config.helper_cpus[1] = 1;
+  rt_config.num_helper_cpus = 2;
+  rt_config.lock_memory = true;
+  rt_config.prefault_stack_size = 524288;
+  rt_config.prefault_heap_size = 67108864;
+
+  RtReport rt_report;
+  apply_rt_config(&rt_config, &rt_report);
+  print_rt_report(&rt_config, &rt_report);
+
+  // one io worker per robot, so the feedback requests run concurrently
+  IoWorkers io_workers;
+  initialize_io_workers(&io_workers, &rt_config);
+  add_io_worker(&io_workers, "kinova_left", [&]() {
+    sample_clock_request(&kinova_left_sample_clock);
+    robot.kinova_left->mediator->refresh_feedback();
+    sample_clock_stamp(&kinova_left_sample_clock);
+  });
+  add_io_worker(&io_workers, "kinova_right", [&]() {
+    sample_clock_request(&kinova_right_sample_clock);
+    robot.kinova_right->mediator->refresh_feedback();
+    sample_clock_stamp(&kinova_right_sample_clock);
+  });
+  add_io_worker(&io_workers, "freddy_base", [&]() {
+    sample_clock_request(&freddy_base_sample_clock);
+    update_base_state(robot.mobile_base->mediator->kelo_base_config,
+                      robot.mobile_base->mediator->ethercat_config);
+    sample_clock_stamp(&freddy_base_sample_clock);
+  });
+  start_io_workers(&io_workers);
+
   // explicitly referesh the robot data
   robot.kinova_left->mediator->refresh_feedback();
   robot.kinova_right->mediator->refresh_feedback();
@@ -474,6 +558,11 @@ int main(int argc, char **argv)
   double base_w3_ang_error_sum = 0.0;
   double base_w4_ang_error_sum = 0.0;
 
+  double base_w1_lin_signal = 0.0, base_w2_lin_signal = 0.0, base_w3_lin_signal = 0.0,
+         base_w4_lin_signal = 0.0;
+  double base_w1_ang_signal = 0.0, base_w2_ang_signal = 0.0, base_w3_ang_signal = 0.0,
+         base_w4_ang_signal = 0.0;
+
   double tau_wheel_ref_limit = 1.5;
 
   double kr_achd_solver_beta[6]{};
@@ -485,10 +574,21 @@ int main(int argc, char **argv)
 
   while (true)
   {
-    auto start_time = std::chrono::high_resolution_clock::now();
+    cycle_scheduler_begin(&cycle_scheduler);
 
     if (flag)
     {
+      print_cycle_scheduler_report(&cycle_scheduler);
+      print_cycle_timing_report(stdout, &cycle_timing);
+      write_cycle_timing_report(&cycle_timing, log_dir_name);
+      STAGE_TIMERS_REPORT(stage_timers, stdout);
+      STAGE_TIMERS_WRITE(stage_timers, log_dir_name);
+      print_overrun_policy_report(stdout, &overrun_policy);
+      print_sample_clock_report(stdout, "kinova_left", &kinova_left_sample_clock);
+      print_sample_clock_report(stdout, "kinova_right", &kinova_right_sample_clock);
+      print_sample_clock_report(stdout, "freddy_base", &freddy_base_sample_clock);
+      print_io_workers_report(stdout, &io_workers);
+      stop_io_workers(&io_workers);
       kr_log_data_vec.writeToOpenFile();
       kl_log_data_vec.writeToOpenFile();
       base_log_data_vec.writeToOpenFile();
@@ -499,10 +599,21 @@ int main(int argc, char **argv)
     }
 
     count++;
-    printf("count: %d\n", count);
+    if (!overrun_policy_skip(&overrun_policy, &cycle_scheduler, 1))
+    {
+      printf("count: %d\n", count);
+    }
 
-    get_robot_data(&robot, *control_loop_dt);
+    STAGE_PROBE_BEGIN(get_robot_data_stage);
+    // acquire the samples of all robots concurrently, stamped with their acquisition time
+    io_workers_request(&io_workers);
+    io_workers_join(&io_workers);
 
+    // the base odometry integrates over the interval between its samples
+    get_robot_data(&robot, freddy_base_sample_clock.dt);
+    STAGE_PROBE_END(stage_timers, get_robot_data_stage);
+
+    STAGE_PROBE_BEGIN(compute_variables_stage);
     KDL::Frame base_to_world;
     base_to_world.p = KDL::Vector(robot.mobile_base->state->x_platform[0],
                                   robot.mobile_base->state->x_platform[1], 0.0);
@@ -552,14 +663,17 @@ int main(int argc, char **argv)
     KDL::Rotation kl_theta_world = base_theta_comp * kl_theta_current;
     KDL::Vector kl_theta_diff = KDL::diff(kl_theta_world, kl_theta_init);
 
+    STAGE_PROBE_END(stage_timers, compute_variables_stage);
+
     // controllers
+    STAGE_PROBE_BEGIN(controllers_stage);
     // pid controller
     double kl_bl_orientation_ang_x_pid_controller_error = 0;
     kl_bl_orientation_ang_x_pid_controller_error = kl_theta_diff.x();
     pidController(
         kl_bl_orientation_ang_x_pid_controller_error, kl_bl_orientation_ang_x_pid_controller_kp,
         kl_bl_orientation_ang_x_pid_controller_ki, kl_bl_orientation_ang_x_pid_controller_kd,
-        *control_loop_dt, kl_bl_orientation_ang_x_pid_controller_error_sum, 1.0,
+        kinova_left_sample_clock.dt, kl_bl_orientation_ang_x_pid_controller_error_sum, 1.0,
         kl_bl_orientation_ang_x_pid_controller_prev_error,
         kl_bl_orientation_ang_x_pid_controller_signal);
 
@@ -569,7 +683,7 @@ int main(int argc, char **argv)
     pidController(
         kl_bl_orientation_ang_y_pid_controller_error, kl_bl_orientation_ang_y_pid_controller_kp,
         kl_bl_orientation_ang_y_pid_controller_ki, kl_bl_orientation_ang_y_pid_controller_kd,
-        *control_loop_dt, kl_bl_orientation_ang_y_pid_controller_error_sum, 1.0,
+        kinova_left_sample_clock.dt, kl_bl_orientation_ang_y_pid_controller_error_sum, 1.0,
         kl_bl_orientation_ang_y_pid_controller_prev_error,
         kl_bl_orientation_ang_y_pid_controller_signal);
 
@@ -579,7 +693,7 @@ int main(int argc, char **argv)
     pidController(
         kl_bl_orientation_ang_z_pid_controller_error, kl_bl_orientation_ang_z_pid_controller_kp,
         kl_bl_orientation_ang_z_pid_controller_ki, kl_bl_orientation_ang_z_pid_controller_kd,
-        *control_loop_dt, kl_bl_orientation_ang_z_pid_controller_error_sum, 1.0,
+        kinova_left_sample_clock.dt, kl_bl_orientation_ang_z_pid_controller_error_sum, 1.0,
         kl_bl_orientation_ang_z_pid_controller_prev_error,
         kl_bl_orientation_ang_z_pid_controller_signal);
 
@@ -589,7 +703,7 @@ int main(int argc, char **argv)
     pidController(
         kr_bl_orientation_ang_x_pid_controller_error, kr_bl_orientation_ang_x_pid_controller_kp,
         kr_bl_orientation_ang_x_pid_controller_ki, kr_bl_orientation_ang_x_pid_controller_kd,
-        *control_loop_dt, kr_bl_orientation_ang_x_pid_controller_error_sum, 1.0,
+        kinova_right_sample_clock.dt, kr_bl_orientation_ang_x_pid_controller_error_sum, 1.0,
         kr_bl_orientation_ang_x_pid_controller_prev_error,
         kr_bl_orientation_ang_x_pid_controller_signal);
 
@@ -599,7 +713,7 @@ int main(int argc, char **argv)
     pidController(
         kr_bl_orientation_ang_y_pid_controller_error, kr_bl_orientation_ang_y_pid_controller_kp,
         kr_bl_orientation_ang_y_pid_controller_ki, kr_bl_orientation_ang_y_pid_controller_kd,
-        *control_loop_dt, kr_bl_orientation_ang_y_pid_controller_error_sum, 1.0,
+        kinova_right_sample_clock.dt, kr_bl_orientation_ang_y_pid_controller_error_sum, 1.0,
         kr_bl_orientation_ang_y_pid_controller_prev_error,
         kr_bl_orientation_ang_y_pid_controller_signal);
 
@@ -609,7 +723,7 @@ int main(int argc, char **argv)
     pidController(
         kr_bl_orientation_ang_z_pid_controller_error, kr_bl_orientation_ang_z_pid_controller_kp,
         kr_bl_orientation_ang_z_pid_controller_ki, kr_bl_orientation_ang_z_pid_controller_kd,
-        *control_loop_dt, kr_bl_orientation_ang_z_pid_controller_error_sum, 1.0,
+        kinova_right_sample_clock.dt, kr_bl_orientation_ang_z_pid_controller_error_sum, 1.0,
         kr_bl_orientation_ang_z_pid_controller_prev_error,
         kr_bl_orientation_ang_z_pid_controller_signal);
 
@@ -624,7 +738,8 @@ int main(int argc, char **argv)
     pidController(kinova_left_bracelet_table_contact_force_pid_controller_error,
                   kinova_left_bracelet_table_contact_force_pid_controller_kp,
                   kinova_left_bracelet_table_contact_force_pid_controller_ki,
-                  kinova_left_bracelet_table_contact_force_pid_controller_kd, *control_loop_dt,
+                  kinova_left_bracelet_table_contact_force_pid_controller_kd,
+                  kinova_left_sample_clock.dt,
                   kinova_left_bracelet_table_contact_force_pid_controller_error_sum, 1.0,
                   kinova_left_bracelet_table_contact_force_pid_controller_prev_error,
                   kinova_left_bracelet_table_contact_force_pid_controller_signal);
@@ -657,7 +772,7 @@ int main(int argc, char **argv)
                          kr_bl_position_lin_y_pid_controller_error);
     pidController(kr_bl_position_lin_y_pid_controller_error,
                   kr_bl_position_lin_y_pid_controller_kp, kr_bl_position_lin_y_pid_controller_ki,
-                  kr_bl_position_lin_y_pid_controller_kd, *control_loop_dt,
+                  kr_bl_position_lin_y_pid_controller_kd, kinova_right_sample_clock.dt,
                   kr_bl_position_lin_y_pid_controller_error_sum, 1.0,
                   kr_bl_position_lin_y_pid_controller_prev_error,
                   kr_bl_position_lin_y_pid_controller_signal);
@@ -670,7 +785,7 @@ int main(int argc, char **argv)
                          kl_bl_position_lin_z_pid_controller_error);
     pidController(kl_bl_position_lin_z_pid_controller_error,
                   kl_bl_position_lin_z_pid_controller_kp, kl_bl_position_lin_z_pid_controller_ki,
-                  kl_bl_position_lin_z_pid_controller_kd, *control_loop_dt,
+                  kl_bl_position_lin_z_pid_controller_kd, kinova_left_sample_clock.dt,
                   kl_bl_position_lin_z_pid_controller_error_sum, 1.0,
                   kl_bl_position_lin_z_pid_controller_prev_error,
                   kl_bl_position_lin_z_pid_controller_signal);
@@ -686,7 +801,8 @@ int main(int argc, char **argv)
     pidController(kinova_right_bracelet_table_contact_force_pid_controller_error,
                   kinova_right_bracelet_table_contact_force_pid_controller_kp,
                   kinova_right_bracelet_table_contact_force_pid_controller_ki,
-                  kinova_right_bracelet_table_contact_force_pid_controller_kd, *control_loop_dt,
+                  kinova_right_bracelet_table_contact_force_pid_controller_kd,
+                  kinova_right_sample_clock.dt,
                   kinova_right_bracelet_table_contact_force_pid_controller_error_sum, 1.0,
                   kinova_right_bracelet_table_contact_force_pid_controller_prev_error,
                   kinova_right_bracelet_table_contact_force_pid_controller_signal);
@@ -713,7 +829,7 @@ int main(int argc, char **argv)
                          kr_bl_position_lin_z_pid_controller_error);
     pidController(kr_bl_position_lin_z_pid_controller_error,
                   kr_bl_position_lin_z_pid_controller_kp, kr_bl_position_lin_z_pid_controller_ki,
-                  kr_bl_position_lin_z_pid_controller_kd, *control_loop_dt,
+                  kr_bl_position_lin_z_pid_controller_kd, kinova_right_sample_clock.dt,
                   kr_bl_position_lin_z_pid_controller_error_sum, 1.0,
                   kr_bl_position_lin_z_pid_controller_prev_error,
                   kr_bl_position_lin_z_pid_controller_signal);
@@ -732,7 +848,7 @@ int main(int argc, char **argv)
                          kl_bl_position_lin_y_pid_controller_error);
     pidController(kl_bl_position_lin_y_pid_controller_error,
                   kl_bl_position_lin_y_pid_controller_kp, kl_bl_position_lin_y_pid_controller_ki,
-                  kl_bl_position_lin_y_pid_controller_kd, *control_loop_dt,
+                  kl_bl_position_lin_y_pid_controller_kd, kinova_left_sample_clock.dt,
                   kl_bl_position_lin_y_pid_controller_error_sum, 1.0,
                   kl_bl_position_lin_y_pid_controller_prev_error,
                   kl_bl_position_lin_y_pid_controller_signal);
@@ -749,7 +865,7 @@ int main(int argc, char **argv)
                          kr_bl_base_distance_controller_error);
     pidController(kr_bl_base_distance_controller_error, kr_bl_base_distance_pid_controller_kp,
                   kr_bl_base_distance_pid_controller_ki, kr_bl_base_distance_pid_controller_kd,
-                  *control_loop_dt, kr_bl_base_distance_pid_error_sum, 50.0,
+                  kinova_right_sample_clock.dt, kr_bl_base_distance_pid_error_sum, 50.0,
                   kr_bl_base_distance_pid_prev_error, kr_bl_base_distance_pid_controller_signal);
 
     // impedance controller
@@ -763,10 +879,13 @@ int main(int argc, char **argv)
                          kl_bl_base_distance_controller_error);
     pidController(kl_bl_base_distance_controller_error, kl_bl_base_distance_pid_controller_kp,
                   kl_bl_base_distance_pid_controller_ki, kl_bl_base_distance_pid_controller_kd,
-                  *control_loop_dt, kl_bl_base_distance_pid_error_sum, 50.0,
+                  kinova_left_sample_clock.dt, kl_bl_base_distance_pid_error_sum, 50.0,
                   kl_bl_base_distance_pid_prev_error, kl_bl_base_distance_pid_controller_signal);
 
+    STAGE_PROBE_END(stage_timers, controllers_stage);
+
     // embed maps
+    STAGE_PROBE_BEGIN(embed_maps_stage);
     double
         kinova_left_bracelet_table_contact_force_embed_map_kl_achd_solver_fext_output_external_wrench
             [6]{};
@@ -953,8 +1072,12 @@ int main(int argc, char **argv)
 
     // std::cout << std::endl;
 
+    STAGE_PROBE_END(stage_timers, embed_maps_stage);
+
     // solvers
+    STAGE_PROBE_BEGIN(solvers_stage);
     // fd solver
+    SOLVER_PROBE_BEGIN(fd_solver_robile_stage);
     double fd_solver_robile_output_torques[8]{};
     double fd_solver_robile_platform_wrench[6]{};
     add(fd_solver_robile_output_external_wrench_kl, fd_solver_robile_platform_wrench,
@@ -965,59 +1088,63 @@ int main(int argc, char **argv)
                             fd_solver_robile_platform_wrench[1],
                             fd_solver_robile_platform_wrench[5]};
 
-    std::cout << "plat_force: ";
-    print_array(plat_force, 3);
-
-    double lin_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    double ang_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    get_pivot_alignment_offsets(&robot, plat_force, lin_offsets, ang_offsets);
-
-    double base_w1_lin_signal, base_w2_lin_signal, base_w3_lin_signal, base_w4_lin_signal = 0.0;
-    double base_w1_ang_signal, base_w2_ang_signal, base_w3_ang_signal, base_w4_ang_signal = 0.0;
-
-    double base_wheel_alignment_controller_kp[4] = {
-        base_wheel_alignment_controller_Kp, base_wheel_alignment_controller_Kp,
-        2.0 * base_wheel_alignment_controller_Kp, base_wheel_alignment_controller_Kp};
-    double base_wheel_alignment_controller_ki[4] = {
-        base_wheel_alignment_controller_Ki, base_wheel_alignment_controller_Ki,
-        2.0 * base_wheel_alignment_controller_Ki, base_wheel_alignment_controller_Ki};
-    double base_wheel_alignment_controller_kd[4] = {
-        base_wheel_alignment_controller_Kd, base_wheel_alignment_controller_Kd,
-        base_wheel_alignment_controller_Kd, base_wheel_alignment_controller_Kd};
-
-    pidController(lin_offsets[0], base_wheel_alignment_controller_kp[0],
-                  base_wheel_alignment_controller_ki[0], base_wheel_alignment_controller_kd[0],
-                  *control_loop_dt, base_w1_lin_error_sum, 10.0, base_w1_lin_prev_error,
-                  base_w1_lin_signal);
-    pidController(lin_offsets[1], base_wheel_alignment_controller_kp[1],
-                  base_wheel_alignment_controller_ki[1], base_wheel_alignment_controller_kd[1],
-                  *control_loop_dt, base_w2_lin_error_sum, 10.0, base_w2_lin_prev_error,
-                  base_w2_lin_signal);
-    pidController(lin_offsets[2], base_wheel_alignment_controller_kp[2],
-                  base_wheel_alignment_controller_ki[2], base_wheel_alignment_controller_kd[2],
-                  *control_loop_dt, base_w3_lin_error_sum, 10.0, base_w3_lin_prev_error,
-                  base_w3_lin_signal);
-    pidController(lin_offsets[3], base_wheel_alignment_controller_kp[3],
-                  base_wheel_alignment_controller_ki[3], base_wheel_alignment_controller_kd[3],
-                  *control_loop_dt, base_w4_lin_error_sum, 10.0, base_w4_lin_prev_error,
-                  base_w4_lin_signal);
-
-    pidController(ang_offsets[0], base_wheel_alignment_controller_kp[0],
-                  base_wheel_alignment_controller_ki[0], base_wheel_alignment_controller_kd[0],
-                  *control_loop_dt, base_w1_ang_error_sum, 10.0, base_w1_ang_prev_error,
-                  base_w1_ang_signal);
-    pidController(ang_offsets[1], base_wheel_alignment_controller_kp[1],
-                  base_wheel_alignment_controller_ki[1], base_wheel_alignment_controller_kd[1],
-                  *control_loop_dt, base_w2_ang_error_sum, 10.0, base_w2_ang_prev_error,
-                  base_w2_ang_signal);
-    pidController(ang_offsets[2], base_wheel_alignment_controller_kp[2],
-                  base_wheel_alignment_controller_ki[2], base_wheel_alignment_controller_kd[2],
-                  *control_loop_dt, base_w3_ang_error_sum, 10.0, base_w3_ang_prev_error,
-                  base_w3_ang_signal);
-    pidController(ang_offsets[3], base_wheel_alignment_controller_kp[3],
-                  base_wheel_alignment_controller_ki[3], base_wheel_alignment_controller_kd[3],
-                  *control_loop_dt, base_w4_ang_error_sum, 10.0, base_w4_ang_prev_error,
-                  base_w4_ang_signal);
+    if (!overrun_policy_skip(&overrun_policy, &cycle_scheduler, 1))
+    {
+      std::cout << "plat_force: ";
+      print_array(plat_force, 3);
+    }
+
+    // base wheel alignment controllers, their signals are held while skipped
+    if (!overrun_policy_skip(&overrun_policy, &cycle_scheduler, 2))
+    {
+      double lin_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
+      double ang_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
+      get_pivot_alignment_offsets(&robot, plat_force, lin_offsets, ang_offsets);
+
+      double base_wheel_alignment_controller_kp[4] = {
+          base_wheel_alignment_controller_Kp, base_wheel_alignment_controller_Kp,
+          2.0 * base_wheel_alignment_controller_Kp, base_wheel_alignment_controller_Kp};
+      double base_wheel_alignment_controller_ki[4] = {
+          base_wheel_alignment_controller_Ki, base_wheel_alignment_controller_Ki,
+          2.0 * base_wheel_alignment_controller_Ki, base_wheel_alignment_controller_Ki};
+      double base_wheel_alignment_controller_kd[4] = {
+          base_wheel_alignment_controller_Kd, base_wheel_alignment_controller_Kd,
+          base_wheel_alignment_controller_Kd, base_wheel_alignment_controller_Kd};
+
+      pidController(lin_offsets[0], base_wheel_alignment_controller_kp[0],
+                    base_wheel_alignment_controller_ki[0], base_wheel_alignment_controller_kd[0],
+                    freddy_base_sample_clock.dt, base_w1_lin_error_sum, 10.0,
+                    base_w1_lin_prev_error, base_w1_lin_signal);
+      pidController(lin_offsets[1], base_wheel_alignment_controller_kp[1],
+                    base_wheel_alignment_controller_ki[1], base_wheel_alignment_controller_kd[1],
+                    freddy_base_sample_clock.dt, base_w2_lin_error_sum, 10.0,
+                    base_w2_lin_prev_error, base_w2_lin_signal);
+      pidController(lin_offsets[2], base_wheel_alignment_controller_kp[2],
+                    base_wheel_alignment_controller_ki[2], base_wheel_alignment_controller_kd[2],
+                    freddy_base_sample_clock.dt, base_w3_lin_error_sum, 10.0,
+                    base_w3_lin_prev_error, base_w3_lin_signal);
+      pidController(lin_offsets[3], base_wheel_alignment_controller_kp[3],
+                    base_wheel_alignment_controller_ki[3], base_wheel_alignment_controller_kd[3],
+                    freddy_base_sample_clock.dt, base_w4_lin_error_sum, 10.0,
+                    base_w4_lin_prev_error, base_w4_lin_signal);
+
+      pidController(ang_offsets[0], base_wheel_alignment_controller_kp[0],
+                    base_wheel_alignment_controller_ki[0], base_wheel_alignment_controller_kd[0],
+                    freddy_base_sample_clock.dt, base_w1_ang_error_sum, 10.0,
+                    base_w1_ang_prev_error, base_w1_ang_signal);
+      pidController(ang_offsets[1], base_wheel_alignment_controller_kp[1],
+                    base_wheel_alignment_controller_ki[1], base_wheel_alignment_controller_kd[1],
+                    freddy_base_sample_clock.dt, base_w2_ang_error_sum, 10.0,
+                    base_w2_ang_prev_error, base_w2_ang_signal);
+      pidController(ang_offsets[2], base_wheel_alignment_controller_kp[2],
+                    base_wheel_alignment_controller_ki[2], base_wheel_alignment_controller_kd[2],
+                    freddy_base_sample_clock.dt, base_w3_ang_error_sum, 10.0,
+                    base_w3_ang_prev_error, base_w3_ang_signal);
+      pidController(ang_offsets[3], base_wheel_alignment_controller_kp[3],
+                    base_wheel_alignment_controller_ki[3], base_wheel_alignment_controller_kd[3],
+                    freddy_base_sample_clock.dt, base_w4_ang_error_sum, 10.0,
+                    base_w4_ang_prev_error, base_w4_ang_signal);
+    }
 
     double wheel_alignment_lin_signals[4] = {base_w1_lin_signal, base_w2_lin_signal,
                                              base_w3_lin_signal, base_w4_lin_signal};
@@ -1075,7 +1202,10 @@ int main(int argc, char **argv)
     //   fd_solver_robile_output_torques[i] += tau_wheel_ref[i];
     // }
 
+    SOLVER_PROBE_END(stage_timers, fd_solver_robile_stage);
+
     // achd_solver_fext
+    SOLVER_PROBE_BEGIN(kl_achd_solver_fext_stage);
     double kl_achd_solver_fext_ext_wrenches[7][6];
     int link_id = -1;
     double
@@ -1112,8 +1242,10 @@ int main(int argc, char **argv)
 
     achd_solver_fext(&robot, kinova_left_base_link, kinova_left_bracelet_link,
                      kl_achd_solver_fext_ext_wrenches, kl_achd_solver_fext_output_torques);
+    SOLVER_PROBE_END(stage_timers, kl_achd_solver_fext_stage);
 
     // achd_solver
+    SOLVER_PROBE_BEGIN(kl_achd_solver_stage);
     double kl_achd_solver_beta[6]{};
     add(kl_bl_position_lin_y_twist_embed_map_kl_achd_solver_output_acceleration_energy,
         kl_achd_solver_beta, kl_achd_solver_beta, 6);
@@ -1143,8 +1275,10 @@ int main(int argc, char **argv)
                 kl_achd_solver_root_acceleration, kl_achd_solver_alpha_transf, kl_solver_beta,
                 kl_achd_solver_feed_forward_torques, kl_achd_solver_predicted_accelerations,
                 kl_achd_solver_output_torques);
+    SOLVER_PROBE_END(stage_timers, kl_achd_solver_stage);
 
     // achd_solver
+    SOLVER_PROBE_BEGIN(kr_achd_solver_stage);
     double kr_achd_solver_beta[6]{};
     add(kr_bl_position_lin_y_twist_embed_map_kr_achd_solver_output_acceleration_energy,
         kr_achd_solver_beta, kr_achd_solver_beta, 6);
@@ -1175,8 +1309,10 @@ int main(int argc, char **argv)
                 kr_achd_solver_root_acceleration, kr_achd_solver_alpha_transf, kr_solver_beta,
                 kr_achd_solver_feed_forward_torques, kr_achd_solver_predicted_accelerations,
                 kr_achd_solver_output_torques);
+    SOLVER_PROBE_END(stage_timers, kr_achd_solver_stage);
 
     // achd_solver_fext
+    SOLVER_PROBE_BEGIN(kr_achd_solver_fext_stage);
     double kr_achd_solver_fext_ext_wrenches[7][6]{};
     link_id = -1;
     double
@@ -1211,8 +1347,11 @@ int main(int argc, char **argv)
     }
     achd_solver_fext(&robot, kinova_right_base_link, kinova_right_bracelet_link,
                      kr_achd_solver_fext_ext_wrenches, kr_achd_solver_fext_output_torques);
+    SOLVER_PROBE_END(stage_timers, kr_achd_solver_fext_stage);
+    STAGE_PROBE_END(stage_timers, solvers_stage);
 
     // Command the torques to the robots
+    STAGE_PROBE_BEGIN(set_robot_command_torques_stage);
     double kinova_right_cmd_tau[7]{};
     add(kr_achd_solver_output_torques, kinova_right_cmd_tau, kinova_right_cmd_tau, 7);
     add(kr_achd_solver_fext_output_torques, kinova_right_cmd_tau, kinova_right_cmd_tau, 7);
@@ -1240,14 +1379,6 @@ int main(int argc, char **argv)
       }
     }
 
-    kr_log_data_vec.addManipulatorData(robot.kinova_right, kr_achd_solver_beta,
-                                       kinova_right_cmd_tau, nullptr);
-    kl_log_data_vec.addManipulatorData(robot.kinova_left, kl_achd_solver_beta, kinova_left_cmd_tau,
-                                       nullptr);
-    base_log_data_vec.addMobileBaseData(robot.mobile_base, robot.mobile_base->state->x_platform,
-                                        robot.mobile_base->state->xd_platform, plat_force,
-                                        fd_solver_robile_output_torques);
-
     // set torques
     if (count > 1)
     {
@@ -1255,18 +1386,24 @@ int main(int argc, char **argv)
     }
     set_manipulator_torques(&robot, kinova_left_base_link, &kinova_left_cmd_tau_kdl);
     set_manipulator_torques(&robot, kinova_right_base_link, &kinova_right_cmd_tau_kdl);
+    STAGE_PROBE_END(stage_timers, set_robot_command_torques_stage);
 
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto elapsed_time = std::chrono::duration<double>(end_time - start_time);
-
-    // if the elapsed time is less than the desired period, busy wait
-    while (elapsed_time < desired_period)
+    // logging, after the torques are sent
+    if (!overrun_policy_skip(&overrun_policy, &cycle_scheduler, 1))
     {
-      end_time = std::chrono::high_resolution_clock::now();
-      elapsed_time = std::chrono::duration<double>(end_time - start_time);
+      kr_log_data_vec.addManipulatorData(robot.kinova_right, kr_achd_solver_beta,
+                                         kinova_right_cmd_tau, nullptr);
+      kl_log_data_vec.addManipulatorData(robot.kinova_left, kl_achd_solver_beta,
+                                         kinova_left_cmd_tau, nullptr);
+      base_log_data_vec.addMobileBaseData(robot.mobile_base, robot.mobile_base->state->x_platform,
+                                          robot.mobile_base->state->xd_platform, plat_force,
+                                          fd_solver_robile_output_torques);
     }
-    control_loop_timestep = elapsed_time.count();
-    // std::cout << "control loop timestep: " << control_loop_timestep << std::endl;
+
+    // wait for the absolute deadline of this cycle
+    control_loop_timestep = cycle_scheduler_wait(&cycle_scheduler);
+    record_cycle_timing(&cycle_timing, &cycle_scheduler);
+    update_overrun_policy(&overrun_policy, &cycle_scheduler);
   }
 
   free_robot_data(&robot);
@@ -14,6 +14,12 @@
 #include <robif2b/functions/ethercat.h>
 #include <robif2b/functions/kelo_drive.h>
 
+#include "base_state_view.hpp"
+#include "ethercat_backend.hpp"
+#include "fieldbus_thread.hpp"
+#include "io_workers.hpp"
+#include "triple_buffer.hpp"
+
 #define NUM_DRIVES 4
 #define NUM_SLAVES 8
 
@@ -212,15 +218,68 @@ int main()
   char ethernet_interface[100] = "eno1";
   initialize_robot(&robot, robot_urdf, ethernet_interface, false);
 
+  // platform simulated by the virtual EtherCAT, ignored on the real segment
+  ethercat_backend_set_platform(NUM_DRIVES, wheel_coordinates, state.kelo_msr.pvt_off,
+                                kelo_base_config.radius, kelo_base_config.castor_offset,
+                                kelo_base_config.half_wheel_distance);
+
   // Schedule
-  robif2b_ethercat_configure(&ecat);
+  ethercat_backend_configure(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
 
-  robif2b_ethercat_start(&ecat);
+  ethercat_backend_start(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
-  
+
+  // the EtherCAT thread owns the PDO exchange, the control loop reads the
+  // latest measurements and hands over its torques through triple buffers
+  struct KeloTorqueCmd
+  {
+    double trq[NUM_DRIVES * 2];
+    int64_t stamp_ns;  // published at, for fieldbus_command_expired
+  };
+  static TripleBuffer<decltype(state.kelo_msr)> kelo_msr_buffer;
+  static TripleBuffer<KeloTorqueCmd> kelo_cmd_buffer;
+  initialize_triple_buffer(&kelo_msr_buffer);
+  initialize_triple_buffer(&kelo_cmd_buffer);
+
+  const double ethercat_frequency = 1000.0;  // Hz, independent of the control loop
+  const int ethercat_cpu = 2;                // -1 to not pin
+  static FieldbusThread ethercat_thread;
+  auto ethercat_exchange = [&, cmd_received = false, cmd_stamp_ns = (int64_t)0]() mutable {
+    bool fresh;
+    const KeloTorqueCmd *cmd = triple_buffer_read(&kelo_cmd_buffer, &fresh);
+    if (fresh)
+    {
+      std::copy(cmd->trq, cmd->trq + NUM_DRIVES * 2, state.kelo_cmd.trq);
+      cmd_stamp_ns = cmd->stamp_ns;
+      cmd_received = true;
+    }
+
+    // the drives are only actuated once the control loop sent torques, and
+    // with zero torques while the control loop stalls
+    if (cmd_received)
+    {
+      if (fieldbus_command_expired(&ethercat_thread, cmd_stamp_ns))
+      {
+        std::fill(state.kelo_cmd.trq, state.kelo_cmd.trq + NUM_DRIVES * 2, 0.0);
+      }
+      robif2b_kelo_drive_actuator_update(&wheel_act);
+    }
+
+    ethercat_backend_update(&ecat);
+    if (state.ecat.error_code < 0)
+      return false;
+    robif2b_kelo_drive_encoder_update(&drive_enc);
+
+    *triple_buffer_back(&kelo_msr_buffer) = state.kelo_msr;
+    triple_buffer_publish(&kelo_msr_buffer);
+    return true;
+  };
+  start_fieldbus_thread(&ethercat_thread, "ethercat", ethercat_frequency, ethercat_cpu,
+                        ethercat_exchange);
+
   const double desired_frequency = 1000.0;                                             // Hz
   const auto desired_period = std::chrono::duration<double>(1.0 / desired_frequency);  // s
   double control_loop_timestep = desired_period.count();                               // s
@@ -462,18 +521,15 @@ int main()
   robot.kinova_left->mediator->refresh_feedback();
   robot.kinova_right->mediator->refresh_feedback();
 
-  robif2b_ethercat_update(&ecat);
-  if (state.ecat.error_code < 0)
+  if (!wait_fieldbus_thread_started(&ethercat_thread))
     return -1;
-  robif2b_kelo_drive_encoder_update(&drive_enc);
+  const auto *kelo_msr = triple_buffer_read(&kelo_msr_buffer, NULL);
 
-  for (int i = 0; i < 4; ++i) {
-      robot.mobile_base->state->pivot_angles[i] = state.kelo_msr.pvt_pos[i];
-  }
-  for (int i = 0; i < 8; ++i) {
-      robot.mobile_base->state->wheel_encoder_values[i] = state.kelo_msr.whl_pos[i];
-      robot.mobile_base->state->qd_wheel[i] = state.kelo_msr.whl_vel[i];
-  }
+  // the alignment reads the base measurements in place, the motion_spec_utils
+  // functions that take the robot get a copy in its MobileBaseState
+  BaseStateView base_state;
+  point_base_state_view(&base_state, kelo_msr, NUM_DRIVES, wheel_coordinates);
+  write_mobile_base_state(&base_state, robot.mobile_base->state);
 
   get_robot_data(&robot, *control_loop_dt);
 
@@ -592,6 +648,15 @@ int main()
   double base_w3_ang_error_sum = 0.0;
   double base_w4_ang_error_sum = 0.0;
 
+  // one io worker per robot, so the feedback requests run concurrently
+  IoWorkers io_workers;
+  initialize_io_workers(&io_workers, NULL);
+  add_io_worker(&io_workers, "kinova_left",
+                [&]() { robot.kinova_left->mediator->refresh_feedback(); });
+  add_io_worker(&io_workers, "kinova_right",
+                [&]() { robot.kinova_right->mediator->refresh_feedback(); });
+  start_io_workers(&io_workers);
+
   int count = 0;
 
   while (true)
@@ -600,9 +665,13 @@ int main()
 
     if (flag)
     {
+      print_io_workers_report(stdout, &io_workers);
+      stop_io_workers(&io_workers);
+      stop_fieldbus_thread(&ethercat_thread);
+      print_fieldbus_thread_report(stdout, &ethercat_thread);
       robif2b_kelo_drive_actuator_stop(&wheel_act);
-      robif2b_ethercat_stop(&ecat);
-      robif2b_ethercat_shutdown(&ecat);
+      ethercat_backend_stop(&ecat);
+      ethercat_backend_shutdown(&ecat);
       free_robot_data(&robot);
       printf("Exiting somewhat cleanly...\n");
       exit(0);
@@ -612,21 +681,15 @@ int main()
     printf("\n");
     // printf("count: %d\n", count);
 
-    robif2b_ethercat_update(&ecat);
-    if (state.ecat.error_code < 0)
+    // acquire the feedback of the arms concurrently, the base measurements
+    // are the latest ones of the EtherCAT thread
+    io_workers_request(&io_workers);
+    if (fieldbus_thread_failed(&ethercat_thread))
       return -1;
-    robif2b_kelo_drive_encoder_update(&drive_enc);
-
-    for (int i = 0; i < 4; ++i) {
-        robot.mobile_base->state->pivot_angles[i] = state.kelo_msr.pvt_pos[i];
-    }
-    for (int i = 0; i < 8; ++i) {
-        robot.mobile_base->state->wheel_encoder_values[i] = state.kelo_msr.whl_pos[i];
-        robot.mobile_base->state->qd_wheel[i] = state.kelo_msr.whl_vel[i];
-    }
-
-    robot.kinova_left->mediator->refresh_feedback();
-    robot.kinova_right->mediator->refresh_feedback();
+    kelo_msr = triple_buffer_read(&kelo_msr_buffer, NULL);
+    point_base_state_view(&base_state, kelo_msr, NUM_DRIVES, wheel_coordinates);
+    write_mobile_base_state(&base_state, robot.mobile_base->state);
+    io_workers_join(&io_workers);
 
     get_robot_data(&robot, *control_loop_dt);
 
@@ -1111,9 +1174,9 @@ int main()
     std::cout << "plat_force: ";
     print_array(plat_force, 3);
 
-    double lin_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    double ang_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    get_pivot_alignment_offsets(&robot, plat_force, lin_offsets, ang_offsets);
+    double lin_offsets[NUM_DRIVES];
+    double ang_offsets[NUM_DRIVES];
+    compute_pivot_alignment_offsets(&base_state, plat_force, lin_offsets, ang_offsets);
 
     double base_w1_lin_signal, base_w2_lin_signal, base_w3_lin_signal, base_w4_lin_signal = 0.0;
     double base_w1_ang_signal, base_w2_ang_signal, base_w3_ang_signal, base_w4_ang_signal = 0.0;
@@ -1335,17 +1398,19 @@ int main()
       }
     }
 
+    KeloTorqueCmd *kelo_cmd = triple_buffer_back(&kelo_cmd_buffer);
     for (size_t i = 0; i < 4; i++)
     {
-      state.kelo_cmd.trq[2 * i] = -fd_solver_robile_output_torques[2 * i];
-      state.kelo_cmd.trq[2 * i + 1] = fd_solver_robile_output_torques[2 * i + 1];
+      kelo_cmd->trq[2 * i] = -fd_solver_robile_output_torques[2 * i];
+      kelo_cmd->trq[2 * i + 1] = fd_solver_robile_output_torques[2 * i + 1];
     }
 
-    // set torques
+    // set torques, the EtherCAT thread sends them with its next exchange
     if (count > 1)
     {
       // raise(SIGINT);
-      robif2b_kelo_drive_actuator_update(&wheel_act);
+      kelo_cmd->stamp_ns = cycle_scheduler_now_ns();
+      triple_buffer_publish(&kelo_cmd_buffer);
     }
     // set_manipulator_torques(&robot, kinova_left_base_link, &kinova_left_cmd_tau_kdl);
     // set_manipulator_torques(&robot, kinova_right_base_link, &kinova_right_cmd_tau_kdl);
@@ -1363,9 +1428,10 @@ int main()
     // std::cout << "control loop timestep: " << control_loop_timestep << std::endl;
   }
 
+  stop_fieldbus_thread(&ethercat_thread);
   robif2b_kelo_drive_actuator_stop(&wheel_act);
-  robif2b_ethercat_stop(&ecat);
-  robif2b_ethercat_shutdown(&ecat);
+  ethercat_backend_stop(&ecat);
+  ethercat_backend_shutdown(&ecat);
   free_robot_data(&robot);
 
   return 0;
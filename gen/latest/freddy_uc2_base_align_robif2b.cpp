@@ -14,6 +14,9 @@
 #include <robif2b/functions/ethercat.h>
 #include <robif2b/functions/kelo_drive.h>
 
+#include "base_state_view.hpp"
+#include "ethercat_backend.hpp"
+
 #define NUM_DRIVES 4
 #define NUM_SLAVES 8
 
@@ -210,12 +213,17 @@ int main()
   char ethernet_interface[100] = "eno1";
   initialize_robot(&robot, robot_urdf, ethernet_interface, true);
 
+  // platform simulated by the virtual EtherCAT, ignored on the real segment
+  ethercat_backend_set_platform(NUM_DRIVES, wheel_coordinates, state.kelo_msr.pvt_off,
+                                kelo_base_config.radius, kelo_base_config.castor_offset,
+                                kelo_base_config.half_wheel_distance);
+
   // Schedule
-  robif2b_ethercat_configure(&ecat);
+  ethercat_backend_configure(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
 
-  robif2b_ethercat_start(&ecat);
+  ethercat_backend_start(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
 
@@ -433,18 +441,17 @@ int main()
   robot.kinova_left->mediator->refresh_feedback();
   robot.kinova_right->mediator->refresh_feedback();
 
-  robif2b_ethercat_update(&ecat);
+  ethercat_backend_update(&ecat);
   if (state.ecat.error_code < 0)
     return -1;
   robif2b_kelo_drive_encoder_update(&drive_enc);
 
-  for (int i = 0; i < 4; ++i) {
-      robot.mobile_base->state->pivot_angles[i] = state.kelo_msr.pvt_pos[i];
-  }
-  for (int i = 0; i < 8; ++i) {
-      robot.mobile_base->state->wheel_encoder_values[i] = state.kelo_msr.whl_pos[i];
-      robot.mobile_base->state->qd_wheel[i] = state.kelo_msr.whl_vel[i];
-  }
+  // the alignment reads the PDO-decoded measurements in place, the
+  // motion_spec_utils functions that take the robot get a copy in its
+  // MobileBaseState
+  BaseStateView base_state;
+  point_base_state_view(&base_state, &state.kelo_msr, NUM_DRIVES, wheel_coordinates);
+  write_mobile_base_state(&base_state, robot.mobile_base->state);
 
   get_robot_data(&robot, *control_loop_dt);
 
@@ -571,8 +578,8 @@ int main()
     if (flag)
     {
       robif2b_kelo_drive_actuator_stop(&wheel_act);
-      robif2b_ethercat_stop(&ecat);
-      robif2b_ethercat_shutdown(&ecat);
+      ethercat_backend_stop(&ecat);
+      ethercat_backend_shutdown(&ecat);
       free_robot_data(&robot);
       printf("Exiting somewhat cleanly...\n");
       exit(0);
@@ -581,18 +588,12 @@ int main()
     count++;
     printf("\n");
 
-    robif2b_ethercat_update(&ecat);
+    ethercat_backend_update(&ecat);
     if (state.ecat.error_code < 0)
       return -1;
     robif2b_kelo_drive_encoder_update(&drive_enc);
 
-    for (int i = 0; i < 4; ++i) {
-        robot.mobile_base->state->pivot_angles[i] = state.kelo_msr.pvt_pos[i];
-    }
-    for (int i = 0; i < 8; ++i) {
-        robot.mobile_base->state->wheel_encoder_values[i] = state.kelo_msr.whl_pos[i];
-        robot.mobile_base->state->qd_wheel[i] = state.kelo_msr.whl_vel[i];
-    }
+    write_mobile_base_state(&base_state, robot.mobile_base->state);
 
     get_robot_data(&robot, *control_loop_dt);
 
@@ -1041,9 +1042,9 @@ int main()
     // std::cout << "plat_force: ";
     // print_array(plat_force, 3);
 
-    double lin_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    double ang_offsets[robot.mobile_base->mediator->kelo_base_config->nWheels];
-    get_pivot_alignment_offsets(&robot, plat_force, lin_offsets, ang_offsets);
+    double lin_offsets[NUM_DRIVES];
+    double ang_offsets[NUM_DRIVES];
+    compute_pivot_alignment_offsets(&base_state, plat_force, lin_offsets, ang_offsets);
 
     double base_w1_lin_signal, base_w2_lin_signal, base_w3_lin_signal, base_w4_lin_signal = 0.0;
     double base_w1_ang_signal, base_w2_ang_signal, base_w3_ang_signal, base_w4_ang_signal = 0.0;
@@ -1322,8 +1323,8 @@ int main()
   }
 
   robif2b_kelo_drive_actuator_stop(&wheel_act);
-  robif2b_ethercat_stop(&ecat);
-  robif2b_ethercat_shutdown(&ecat);
+  ethercat_backend_stop(&ecat);
+  ethercat_backend_shutdown(&ecat);
   free_robot_data(&robot);
 
   return 0;
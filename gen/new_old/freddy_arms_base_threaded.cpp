@@ -18,9 +18,7 @@ extern "C"
 
 #include "motion_spec_utils/log_structs.hpp"
 
-#include <thread>
-#include <mutex>
-#include <condition_variable>
+#include "base_comm_thread.hpp"
 
 volatile sig_atomic_t flag = 0;
 
@@ -46,12 +44,6 @@ int main()
     }
   }
 
-  std::mutex data_mutex;
-  std::condition_variable cv;
-  bool run_thread = true;
-  bool communicate = false;
-  double tau_command[8];
-
   // Initialize the robot structs
   Manipulator<kinova_mediator> kinova_right;
   kinova_right.base_frame = "kinova_right_base_link";
@@ -468,8 +460,27 @@ int main()
   base_w3_ang_prev_error = ang_offsets[2];
   base_w4_ang_prev_error = ang_offsets[3];
 
-  std::thread comm_thread(base_communication_thread, &robot, tau_command, std::ref(data_mutex),
-                          std::ref(run_thread), std::ref(cv), std::ref(communicate));
+  // real-time setup of the control thread, the communication thread runs
+  // with its policy on the helper cpus
+  RtConfig rt_config = {};
+  rt_config.policy = SCHED_FIFO;
+  rt_config.priority = 80;
+  rt_config.control_cpu = 2;
+  rt_config.helper_cpus[0] = 0;
+  rt_config.helper_cpus[1] = 1;
+  rt_config.num_helper_cpus = 2;
+  rt_config.lock_memory = true;
+  rt_config.prefault_stack_size = 524288;
+  rt_config.prefault_heap_size = 67108864;
+
+  RtReport rt_report;
+  apply_rt_config(&rt_config, &rt_report);
+  print_rt_report(&rt_config, &rt_report);
+
+  // the base torques are sent by the communication thread, which spins up to
+  // 200 us for the next command before sleeping
+  static BaseCommThread base_comm;
+  start_base_comm_thread(&base_comm, &robot, 200e-6, control_loop_timestep, &rt_config);
 
   int count = 0;
 
@@ -479,9 +490,8 @@ int main()
 
     if (flag)
     {
-      run_thread = false;
-      cv.notify_all();
-      comm_thread.join();
+      stop_base_comm_thread(&base_comm);
+      print_base_comm_report(stdout, &base_comm);
       free_robot_data(&robot);
       printf("Exiting somewhat cleanly...\n");
       exit(0);
@@ -491,9 +501,11 @@ int main()
     printf("\n");
     // printf("count: %d\n", count);
 
-    update_base_state(robot.mobile_base->mediator->kelo_base_config,
-                      robot.mobile_base->mediator->ethercat_config);
-    get_robot_data(&robot, *control_loop_dt);
+    // the robot data of the last cycle is held while the base exchange runs
+    if (base_comm_poll(&base_comm))
+    {
+      get_robot_data(&robot, base_comm.state_dt);
+    }
 
     KDL::Frame base_to_world;
     base_to_world.p = KDL::Vector(robot.mobile_base->state->x_platform[0],
@@ -1225,13 +1237,7 @@ int main()
 
     // set torques
     // set_mobile_base_torques(&robot, fd_solver_robile_output_torques);
-    {
-      std::lock_guard<std::mutex> lk(data_mutex);
-      std::copy(std::begin(fd_solver_robile_output_torques),
-                std::end(fd_solver_robile_output_torques), tau_command);
-      communicate = true;
-    }
-    cv.notify_one();
+    base_comm_send_torques(&base_comm, fd_solver_robile_output_torques);
     set_manipulator_torques(&robot, kinova_left_base_link, &kinova_left_cmd_tau_kdl1);
     set_manipulator_torques(&robot, kinova_right_base_link, &kinova_right_cmd_tau_kdl1);
 
@@ -1251,9 +1257,7 @@ int main()
     // std::cout << "control loop timestep: " << control_loop_timestep << std::endl;
   }
 
-  run_thread = false;
-  cv.notify_all();
-  comm_thread.join();
+  stop_base_comm_thread(&base_comm);
 
   free_robot_data(&robot);
 
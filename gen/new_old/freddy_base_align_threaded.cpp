@@ -18,9 +18,7 @@ extern "C"
 
 #include <unsupported/Eigen/MatrixFunctions>
 
-#include <thread>
-#include <mutex>
-#include <condition_variable>
+#include "base_comm_thread.hpp"
 
 volatile sig_atomic_t flag = 0;
 
@@ -46,12 +44,6 @@ int main(int argc, char **argv)
     }
   }
 
-  std::mutex data_mutex;
-  std::condition_variable cv;
-  bool run_thread = true;
-  bool communicate = false;
-  double tau_command[8];
-
   // read the platform force from the command line
   double pf[3] = {0.0, 0.0, 0.0};
   if (argc == 4)
@@ -148,8 +140,27 @@ int main(int argc, char **argv)
   w4_lin_prev_error = lin_offsets[3];
   w4_ang_prev_error = ang_offsets[3];
 
-  std::thread comm_thread(base_communication_thread, &robot, tau_command, std::ref(data_mutex),
-                          std::ref(run_thread), std::ref(cv), std::ref(communicate));
+  // real-time setup of the control thread, the communication thread runs
+  // with its policy on the helper cpus
+  RtConfig rt_config = {};
+  rt_config.policy = SCHED_FIFO;
+  rt_config.priority = 80;
+  rt_config.control_cpu = 2;
+  rt_config.helper_cpus[0] = 0;
+  rt_config.helper_cpus[1] = 1;
+  rt_config.num_helper_cpus = 2;
+  rt_config.lock_memory = true;
+  rt_config.prefault_stack_size = 524288;
+  rt_config.prefault_heap_size = 67108864;
+
+  RtReport rt_report;
+  apply_rt_config(&rt_config, &rt_report);
+  print_rt_report(&rt_config, &rt_report);
+
+  // the base torques are sent by the communication thread, which spins up to
+  // 200 us for the next command before sleeping
+  static BaseCommThread base_comm;
+  start_base_comm_thread(&base_comm, &robot, 200e-6, control_loop_timestep, &rt_config);
 
   int count = 0;
 
@@ -160,9 +171,8 @@ int main(int argc, char **argv)
     if (flag)
     {
       printf("Exiting somewhat cleanly...\n");
-      run_thread = false;
-      cv.notify_all();
-      comm_thread.join();
+      stop_base_comm_thread(&base_comm);
+      print_base_comm_report(stdout, &base_comm);
       free_robot_data(&robot);
       exit(0);
     }
@@ -171,9 +181,11 @@ int main(int argc, char **argv)
     printf("\n");
     // printf("count: %d\n", count);
 
-    update_base_state(robot.mobile_base->mediator->kelo_base_config,
-                      robot.mobile_base->mediator->ethercat_config);
-    get_robot_data(&robot, *control_loop_dt);
+    // the robot data of the last cycle is held while the base exchange runs
+    if (base_comm_poll(&base_comm))
+    {
+      get_robot_data(&robot, base_comm.state_dt);
+    }
     // std::cout << std::endl;
     // std::cout << "odom: ";
     // print_array(robot.mobile_base->state->x_platform, 3);
@@ -273,12 +285,7 @@ int main(int argc, char **argv)
       }
     }
 
-    {
-      std::lock_guard<std::mutex> lk(data_mutex);
-      std::copy(std::begin(tau_wheel_c), std::end(tau_wheel_c), tau_command);
-      communicate = true;
-    }
-    cv.notify_one();
+    base_comm_send_torques(&base_comm, tau_wheel_c);
 
     // set_mobile_base_torques(&robot, tau_wheel_c);
 
@@ -295,9 +302,7 @@ int main(int argc, char **argv)
     // std::cout << "control loop timestep: " << control_loop_timestep << std::endl;
   }
 
-  run_thread = false;
-  cv.notify_all();
-  comm_thread.join();
+  stop_base_comm_thread(&base_comm);
 
   free_robot_data(&robot);
 
@@ -0,0 +1,120 @@
+#ifndef OVERRUN_POLICY_HPP
+#define OVERRUN_POLICY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "cycle_scheduler.hpp"
+
+#define OVERRUN_POLICY_MAX_LEVELS 8
+
+/**
+ * Degradation of the control loop under overruns.
+ *
+ * Non-critical parts of the loop are assigned a degradation level in the IR
+ * (1 = first to be dropped). After an overrun the loop degrades by one level
+ * and skips every part with a level up to the current one, holding their
+ * last outputs. After `recover_cycles` cycles without an overrun it recovers
+ * one level again.
+ *
+ * Independently of the level, a part is also skipped if the current cycle
+ * already used more than `guard_fraction` of the period, so a transient load
+ * is absorbed within the cycle instead of cascading into the next ones.
+ */
+struct OverrunPolicy
+{
+  int num_levels;
+  int level;  // 0: nothing is skipped
+  long recover_cycles;
+  int64_t guard_ns;  // skip non-critical parts after this time into the cycle
+
+  long calm_cycles;  // cycles since the last overrun
+
+  // statistics
+  long level_cycles[OVERRUN_POLICY_MAX_LEVELS + 1];  // cycles spent at each level
+  long level_entries[OVERRUN_POLICY_MAX_LEVELS + 1];  // times each level was entered
+  std::atomic<long> guard_skips;                      // parts skipped by the guard, by any thread
+};
+
+/**
+ * @param num_levels number of degradation levels
+ * @param recover_cycles cycles without overrun to recover one level
+ * @param guard_fraction fraction of the period after which non-critical parts
+ *                       are skipped, >= 1.0 to disable the guard
+ */
+inline void initialize_overrun_policy(OverrunPolicy *policy, const CycleScheduler *scheduler,
+                                      int num_levels, long recover_cycles, double guard_fraction)
+{
+  policy->num_levels =
+      num_levels > OVERRUN_POLICY_MAX_LEVELS ? OVERRUN_POLICY_MAX_LEVELS : num_levels;
+  policy->level = 0;
+  policy->recover_cycles = recover_cycles;
+  policy->guard_ns = (int64_t)(guard_fraction * scheduler->period_ns);
+  policy->calm_cycles = 0;
+
+  for (int i = 0; i <= OVERRUN_POLICY_MAX_LEVELS; i++)
+  {
+    policy->level_cycles[i] = 0;
+    policy->level_entries[i] = 0;
+  }
+  policy->guard_skips = 0;
+}
+
+/**
+ * Updates the degradation level from the last cycle, to be called right after
+ * cycle_scheduler_wait.
+ */
+inline void update_overrun_policy(OverrunPolicy *policy, const CycleScheduler *scheduler)
+{
+  if (scheduler->last_slack_ns < 0)
+  {
+    policy->calm_cycles = 0;
+    if (policy->level < policy->num_levels)
+    {
+      policy->level++;
+      policy->level_entries[policy->level]++;
+    }
+  }
+  else if (policy->level > 0 && ++policy->calm_cycles >= policy->recover_cycles)
+  {
+    policy->calm_cycles = 0;
+    policy->level--;
+    policy->level_entries[policy->level]++;
+  }
+
+  policy->level_cycles[policy->level]++;
+}
+
+/**
+ * @return true if a part with the given degradation level has to be skipped
+ *         in the current cycle
+ */
+inline bool overrun_policy_skip(OverrunPolicy *policy, const CycleScheduler *scheduler,
+                                int level)
+{
+  if (level <= policy->level)
+  {
+    return true;
+  }
+
+  if (cycle_scheduler_now_ns() - scheduler->cycle_start_ns > policy->guard_ns)
+  {
+    policy->guard_skips.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  return false;
+}
+
+inline void print_overrun_policy_report(FILE *file, const OverrunPolicy *policy)
+{
+  fprintf(file, "degradation level: cycles (entered)\n");
+  for (int i = 0; i <= policy->num_levels; i++)
+  {
+    fprintf(file, "  %d: %ld (%ld)\n", i, policy->level_cycles[i], policy->level_entries[i]);
+  }
+  fprintf(file, "skipped by the cycle guard: %ld\n", policy->guard_skips.load());
+}
+
+#endif  // OVERRUN_POLICY_HPP
@@ -0,0 +1,376 @@
+#ifndef PROCESS_LINK_HPP
+#define PROCESS_LINK_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include "cycle_histogram.hpp"
+#include "cycle_scheduler.hpp"
+
+#define PROCESS_LINK_CACHE_LINE 64
+#define PROCESS_LINK_VERSION 1
+#define PROCESS_LINK_MAX_ARMS 2
+#define PROCESS_LINK_ARM_JOINTS 7
+#define PROCESS_LINK_BASE_DRIVES 4
+#define PROCESS_LINK_READ_RETRIES 16       // attempts before a read counts as failed
+#define PROCESS_LINK_ATTACH_TIMEOUT_NS 1000000000LL  // for the peer initializing the segment
+
+enum ProcessLinkSide
+{
+  PROCESS_LINK_ARMS,
+  PROCESS_LINK_BASE,
+};
+
+/**
+ * Measured state of the arms, published by the arm-controller process.
+ */
+struct ArmsLinkState
+{
+  long cycle;
+  int64_t stamp_ns;  // acquisition time, CLOCK_MONOTONIC
+  int num_arms;
+  double q[PROCESS_LINK_MAX_ARMS][PROCESS_LINK_ARM_JOINTS];    // [rad]
+  double qd[PROCESS_LINK_MAX_ARMS][PROCESS_LINK_ARM_JOINTS];   // [rad/s]
+  double tau[PROCESS_LINK_MAX_ARMS][PROCESS_LINK_ARM_JOINTS];  // [Nm]
+};
+
+/**
+ * Measured state and odometry of the Kelo base, published by the
+ * base-controller process.
+ */
+struct BaseLinkState
+{
+  long cycle;
+  int64_t stamp_ns;  // acquisition time, CLOCK_MONOTONIC
+  int num_drives;
+  double pivot_angles[PROCESS_LINK_BASE_DRIVES];          // [rad]
+  double wheel_positions[2 * PROCESS_LINK_BASE_DRIVES];   // [rad]
+  double wheel_velocities[2 * PROCESS_LINK_BASE_DRIVES];  // [rad/s]
+  double x_platform[3];   // x [m], y [m], yaw [rad] in the odometry frame
+  double xd_platform[3];  // [m/s], [m/s], [rad/s]
+};
+
+/**
+ * Latest value of one writer process for any number of reader processes
+ * (seqlock). The writer makes the sequence odd while it copies the value and
+ * even again afterwards, a reader copies the value and retries if the
+ * sequence was odd or changed meanwhile. Neither side ever blocks on the
+ * other, so a writer that crashed mid-write only costs the readers a failed
+ * read until it is restarted.
+ */
+template <typename T>
+struct LinkMailbox
+{
+  static_assert(std::is_trivially_copyable<T>::value, "mailbox values are copied bytewise");
+
+  alignas(PROCESS_LINK_CACHE_LINE) std::atomic<uint64_t> sequence;
+  std::atomic<uint32_t> attachments;  // bumped by every writer process attaching
+  alignas(PROCESS_LINK_CACHE_LINE) T value;
+};
+
+/**
+ * Layout of the shared-memory segment. The first process to attach fills in
+ * the header, the second one checks that both run the same loop period.
+ * `epoch_ns` is the common cycle clock: both processes release their cycles
+ * at epoch_ns + k * period_ns on CLOCK_MONOTONIC, which is system-wide.
+ */
+struct ProcessLinkSegment
+{
+  std::atomic<uint32_t> state;  // 0 new, 1 initializing, 2 ready
+  uint32_t version;
+  int64_t epoch_ns;
+  int64_t period_ns;
+
+  LinkMailbox<ArmsLinkState> arms;
+  LinkMailbox<BaseLinkState> base;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the mailboxes are shared between processes");
+
+/**
+ * Link of one of the cooperating processes to the other one, see
+ * open_process_link. Each process publishes the state of its own robots and
+ * receives the state of the robots of its peer once per cycle.
+ */
+struct ProcessLink
+{
+  const char *name;
+  ProcessLinkSide side;
+  int fd;
+  ProcessLinkSegment *segment;
+  int64_t stale_ns;  // age after which the state of the peer is stale
+
+  // last state received from the peer, held while the peer is stale
+  ArmsLinkState arms;
+  BaseLinkState base;
+  bool peer_fresh;    // a newer state than in the last cycle was received
+  bool peer_stale;    // the received state is older than stale_ns
+  int64_t peer_age_ns;
+
+  long published;
+  long received;
+  long failed_reads;  // the peer was writing during all retries
+  long stale_cycles;
+  long peer_restarts;
+  uint32_t peer_attachments;
+  CycleHistogram peer_age;  // [ns] at every cycle the peer state was not stale
+};
+
+template <typename T>
+inline void publish_link_mailbox(LinkMailbox<T> *mailbox, const T *value)
+{
+  uint64_t sequence = mailbox->sequence.load(std::memory_order_relaxed);
+  sequence += sequence & 1;  // a previous writer crashed mid-write
+
+  mailbox->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy((void *)&mailbox->value, (const void *)value, sizeof(T));
+  mailbox->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/**
+ * @return false if the writer was writing during all retries, `value` is
+ *         unchanged then
+ */
+template <typename T>
+inline bool read_link_mailbox(const LinkMailbox<T> *mailbox, T *value)
+{
+  T copy;
+
+  for (int i = 0; i < PROCESS_LINK_READ_RETRIES; i++)
+  {
+    uint64_t before = mailbox->sequence.load(std::memory_order_acquire);
+    if (before & 1)
+    {
+      continue;
+    }
+
+    memcpy((void *)&copy, (const void *)&mailbox->value, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (mailbox->sequence.load(std::memory_order_relaxed) == before)
+    {
+      *value = copy;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline void initialize_process_link_segment(ProcessLinkSegment *segment, int64_t period_ns)
+{
+  segment->version = PROCESS_LINK_VERSION;
+  segment->period_ns = period_ns;
+  // first release of the common clock, far enough ahead for the peer to attach
+  segment->epoch_ns = cycle_scheduler_now_ns() + period_ns;
+
+  segment->arms.sequence.store(0);
+  segment->arms.attachments.store(0);
+  memset((void *)&segment->arms.value, 0, sizeof(segment->arms.value));
+  segment->base.sequence.store(0);
+  segment->base.attachments.store(0);
+  memset((void *)&segment->base.value, 0, sizeof(segment->base.value));
+}
+
+/**
+ * Attaches to the shared-memory segment `name` (see shm_open), creating and
+ * initializing it if this is the first process, whichever side that is. A
+ * restarted process attaches to the existing segment and keeps its clock.
+ * The segment is not removed on exit, so that one side can be restarted while
+ * the other keeps running; `rm /dev/shm/<name>` resets it.
+ *
+ * @param period_ns period of the loop, must be the same for both sides
+ * @param stale_cycles periods after which the state of the peer is stale
+ * @return 0 on success, -1 if the segment can not be mapped or is used with a
+ *         different period or version
+ */
+inline int open_process_link(ProcessLink *link, const char *name, ProcessLinkSide side,
+                             int64_t period_ns, int stale_cycles)
+{
+  memset((void *)link, 0, sizeof(*link));
+  link->name = name;
+  link->side = side;
+  link->stale_ns = stale_cycles * period_ns;
+  link->peer_stale = true;
+  initialize_cycle_histogram(&link->peer_age);
+
+  link->fd = shm_open(name, O_CREAT | O_RDWR, 0660);
+  if (link->fd < 0)
+  {
+    perror("shm_open");
+    return -1;
+  }
+
+  // a new segment is zero-filled, resizing an existing one to its size keeps it
+  if (ftruncate(link->fd, sizeof(ProcessLinkSegment)) != 0)
+  {
+    perror("ftruncate");
+    close(link->fd);
+    return -1;
+  }
+
+  void *address =
+      mmap(NULL, sizeof(ProcessLinkSegment), PROT_READ | PROT_WRITE, MAP_SHARED, link->fd, 0);
+  if (address == MAP_FAILED)
+  {
+    perror("mmap");
+    close(link->fd);
+    return -1;
+  }
+  link->segment = (ProcessLinkSegment *)address;
+
+  ProcessLinkSegment *segment = link->segment;
+  uint32_t state = 0;
+  if (segment->state.compare_exchange_strong(state, 1))
+  {
+    initialize_process_link_segment(segment, period_ns);
+    segment->state.store(2, std::memory_order_release);
+  }
+  else
+  {
+    int64_t timeout_ns = cycle_scheduler_now_ns() + PROCESS_LINK_ATTACH_TIMEOUT_NS;
+    while (segment->state.load(std::memory_order_acquire) != 2)
+    {
+      if (cycle_scheduler_now_ns() > timeout_ns)
+      {
+        // the peer crashed while initializing
+        initialize_process_link_segment(segment, period_ns);
+        segment->state.store(2, std::memory_order_release);
+      }
+    }
+  }
+
+  if (segment->version != PROCESS_LINK_VERSION || segment->period_ns != period_ns)
+  {
+    printf("Process link %s: version %u, period %ld ns, expected version %d, period %ld ns\n",
+           name, segment->version, (long)segment->period_ns, PROCESS_LINK_VERSION,
+           (long)period_ns);
+    munmap(address, sizeof(ProcessLinkSegment));
+    close(link->fd);
+    return -1;
+  }
+
+  if (side == PROCESS_LINK_ARMS)
+  {
+    segment->arms.attachments.fetch_add(1);
+    link->peer_attachments = segment->base.attachments.load();
+  }
+  else
+  {
+    segment->base.attachments.fetch_add(1);
+    link->peer_attachments = segment->arms.attachments.load();
+  }
+
+  return 0;
+}
+
+/**
+ * Instant of the first release of the common cycle clock, see
+ * cycle_scheduler_align.
+ */
+inline int64_t process_link_epoch_ns(const ProcessLink *link)
+{
+  return link->segment->epoch_ns;
+}
+
+inline void publish_arms_link_state(ProcessLink *link, const ArmsLinkState *state)
+{
+  publish_link_mailbox(&link->segment->arms, state);
+  link->published++;
+}
+
+inline void publish_base_link_state(ProcessLink *link, const BaseLinkState *state)
+{
+  publish_link_mailbox(&link->segment->base, state);
+  link->published++;
+}
+
+/**
+ * Receives the latest state of the peer, once per cycle. The last state is
+ * held if the peer published nothing new, and marked stale once it is older
+ * than the stale period, e.g. while the peer restarts.
+ *
+ * @return true if the state of the peer is not stale
+ */
+inline bool process_link_receive(ProcessLink *link)
+{
+  ProcessLinkSegment *segment = link->segment;
+  bool read;
+  int64_t last_stamp_ns;
+  int64_t stamp_ns;
+  uint32_t attachments;
+
+  if (link->side == PROCESS_LINK_ARMS)
+  {
+    last_stamp_ns = link->base.stamp_ns;
+    read = read_link_mailbox(&segment->base, &link->base);
+    stamp_ns = link->base.stamp_ns;
+    attachments = segment->base.attachments.load(std::memory_order_relaxed);
+  }
+  else
+  {
+    last_stamp_ns = link->arms.stamp_ns;
+    read = read_link_mailbox(&segment->arms, &link->arms);
+    stamp_ns = link->arms.stamp_ns;
+    attachments = segment->arms.attachments.load(std::memory_order_relaxed);
+  }
+
+  link->peer_fresh = read && stamp_ns != last_stamp_ns;
+  if (!read)
+  {
+    link->failed_reads++;
+  }
+  if (link->peer_fresh)
+  {
+    link->received++;
+  }
+  if (attachments != link->peer_attachments)
+  {
+    link->peer_restarts += link->peer_attachments != 0 ? 1 : 0;
+    link->peer_attachments = attachments;
+  }
+
+  // a peer that never published has a stamp of 0
+  link->peer_age_ns = cycle_scheduler_now_ns() - stamp_ns;
+  link->peer_stale = stamp_ns == 0 || link->peer_age_ns > link->stale_ns;
+  if (link->peer_stale)
+  {
+    link->stale_cycles++;
+  }
+  else
+  {
+    record_cycle_histogram(&link->peer_age, link->peer_age_ns);
+  }
+
+  return !link->peer_stale;
+}
+
+/**
+ * Unmaps the segment, the peer keeps running on it.
+ */
+inline void close_process_link(ProcessLink *link)
+{
+  munmap((void *)link->segment, sizeof(ProcessLinkSegment));
+  close(link->fd);
+  link->segment = NULL;
+}
+
+inline void print_process_link_report(FILE *file, const ProcessLink *link)
+{
+  fprintf(file, "process link %s (%s): published %ld, received %ld, failed reads %ld, "
+          "stale cycles %ld, peer restarts %ld\n",
+          link->name, link->side == PROCESS_LINK_ARMS ? "arms" : "base", link->published,
+          link->received, link->failed_reads, link->stale_cycles, link->peer_restarts);
+  print_cycle_histogram_summary(file, "peer age", &link->peer_age);
+}
+
+#endif  // PROCESS_LINK_HPP
@@ -0,0 +1,153 @@
+#ifndef PROCESS_MIRRORS_HPP
+#define PROCESS_MIRRORS_HPP
+
+#include <kdl/jntarray.hpp>
+#include <kinova_mediator/mediator.hpp>
+#include <motion_spec_utils/utils.hpp>
+
+#include "base_state_view.hpp"
+#include "process_link.hpp"
+
+/**
+ * Stand-in for the mediator of an arm controlled by the peer process. The
+ * joint state is the one the peer published over the process link, there is
+ * no connection to the arm: initialize and set_control_mode do nothing, so
+ * initialize_robot only connects the robots of this process, and commands are
+ * dropped, the peer commands the arm.
+ *
+ * motion_spec_utils reads the joint state through the virtual interface of
+ * the mediator, refresh_feedback is called on the concrete type by the
+ * generated code after the link received the state of the peer.
+ */
+class mirror_kinova_mediator : public kinova_mediator
+{
+ public:
+  /**
+   * @param arm index of the arm in the ArmsLinkState of the peer
+   */
+  mirror_kinova_mediator(const ProcessLink *link, int arm)
+      : link(link),
+        arm(arm),
+        q(PROCESS_LINK_ARM_JOINTS),
+        qd(PROCESS_LINK_ARM_JOINTS),
+        tau(PROCESS_LINK_ARM_JOINTS)
+  {
+  }
+
+  void initialize(const int robot_model, const int robot_id, const double DT) override {}
+
+  int set_control_mode(const int desired_control_mode) override { return 0; }
+
+  void get_joint_state(KDL::JntArray &joint_positions, KDL::JntArray &joint_velocities,
+                       KDL::JntArray &joint_torques) override
+  {
+    joint_positions = q;
+    joint_velocities = qd;
+    joint_torques = tau;
+  }
+
+  void get_joint_positions(KDL::JntArray &joint_positions) override { joint_positions = q; }
+
+  void get_joint_velocities(KDL::JntArray &joint_velocities) override
+  {
+    joint_velocities = qd;
+  }
+
+  void get_joint_torques(KDL::JntArray &joint_torques) override { joint_torques = tau; }
+
+  int set_joint_torques(const KDL::JntArray &joint_torques) override { return 0; }
+
+  /**
+   * Copies the last state received from the peer, held while the peer is
+   * stale.
+   */
+  void refresh_feedback()
+  {
+    for (int i = 0; i < PROCESS_LINK_ARM_JOINTS; i++)
+    {
+      q(i) = link->arms.q[arm][i];
+      qd(i) = link->arms.qd[arm][i];
+      tau(i) = link->arms.tau[arm][i];
+    }
+  }
+
+ private:
+  const ProcessLink *link;
+  int arm;
+
+  KDL::JntArray q;
+  KDL::JntArray qd;
+  KDL::JntArray tau;
+};
+
+/**
+ * Copies the joint state of an arm of this process into the state published
+ * to the peer.
+ */
+inline void write_arm_link_state(kinova_mediator *mediator, int arm, ArmsLinkState *state)
+{
+  KDL::JntArray q(PROCESS_LINK_ARM_JOINTS);
+  KDL::JntArray qd(PROCESS_LINK_ARM_JOINTS);
+  KDL::JntArray tau(PROCESS_LINK_ARM_JOINTS);
+  mediator->get_joint_state(q, qd, tau);
+
+  for (int i = 0; i < PROCESS_LINK_ARM_JOINTS; i++)
+  {
+    state->q[arm][i] = q(i);
+    state->qd[arm][i] = qd(i);
+    state->tau[arm][i] = tau(i);
+  }
+  if (arm >= state->num_arms)
+  {
+    state->num_arms = arm + 1;
+  }
+}
+
+/**
+ * Copies the measured state and the odometry of the base of this process into
+ * the state published to the peer.
+ */
+inline void write_base_link_state(const BaseStateView *view, const MobileBaseState *base_state,
+                                  BaseLinkState *state)
+{
+  state->num_drives = view->num_drives;
+  for (int i = 0; i < view->num_drives; i++)
+  {
+    state->pivot_angles[i] = view->pivot_angles[i];
+  }
+  for (int i = 0; i < 2 * view->num_drives; i++)
+  {
+    state->wheel_positions[i] = view->wheel_positions[i];
+    state->wheel_velocities[i] = view->wheel_velocities[i];
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    state->x_platform[i] = base_state->x_platform[i];
+    state->xd_platform[i] = base_state->xd_platform[i];
+  }
+}
+
+/**
+ * Overwrites the state of the base mirrored from the peer with the last state
+ * it published, after get_robot_data, so that the odometry is the one
+ * integrated by the peer and not integrated a second time.
+ */
+inline void read_base_link_state(const BaseLinkState *state, MobileBaseState *base_state)
+{
+  BaseStateView view;
+  view.num_drives = state->num_drives;
+  view.pivot_angles = state->pivot_angles;
+  view.pivot_velocities = NULL;
+  view.wheel_positions = state->wheel_positions;
+  view.wheel_velocities = state->wheel_velocities;
+  view.wheel_coordinates = NULL;
+  write_mobile_base_state(&view, base_state);
+
+  for (int i = 0; i < 3; i++)
+  {
+    base_state->x_platform[i] = state->x_platform[i];
+    base_state->xd_platform[i] = state->xd_platform[i];
+  }
+}
+
+#endif  // PROCESS_MIRRORS_HPP
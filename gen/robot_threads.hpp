@@ -0,0 +1,268 @@
+#ifndef ROBOT_THREADS_HPP
+#define ROBOT_THREADS_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+#include "cycle_histogram.hpp"
+#include "cycle_scheduler.hpp"
+#include "rt_setup.hpp"
+#include "spin_barrier.hpp"
+
+#define ROBOT_THREADS_MAX 8
+
+struct RobotThreads;
+
+/**
+ * One real-time thread per robot, each running the sense and act halves of
+ * its own part of the control loop: acquiring its samples, and computing the
+ * compute variables, controllers and solvers that only feed its commands
+ * before commanding it. A cycle costs the slowest robot instead of the sum.
+ *
+ * The control thread runs the part that needs all robots between the two
+ * halves (get_robot_data and the entries feeding several robots), and the
+ * halves of one robot itself, so that it does not idle while the robot
+ * threads compute. All threads meet at a spin barrier four times a cycle:
+ *
+ *   start | sense | sensed | shared (control thread) | shared done | act | done
+ */
+struct RobotThread
+{
+  const char *name;
+  int cpu;  // -1 for the helper cpus
+  std::function<void()> sense;
+  std::function<void()> act;
+  pthread_t thread;
+  bool on_control_thread;
+
+  RobotThreads *threads;
+
+  // statistics, only written by the thread running the robot
+  CycleHistogram sense_ns;
+  CycleHistogram act_ns;
+};
+
+struct RobotThreads
+{
+  RobotThread threads[ROBOT_THREADS_MAX];
+  int num_threads;
+  const RtConfig *rt_config;
+
+  SpinBarrier barrier;  // the robot threads and the control thread
+  std::atomic<bool> run;
+
+  // statistics of the control thread
+  CycleHistogram shared_ns;  // between the sensed and the shared done barrier
+  CycleHistogram wait_ns;    // at the done barrier, for the slowest robot
+};
+
+/**
+ * @param rt_config real-time configuration of the process, robot threads
+ *                  without a cpu of their own are pinned to its helper cpus,
+ *                  NULL to keep the affinity
+ */
+inline void initialize_robot_threads(RobotThreads *threads, const RtConfig *rt_config)
+{
+  threads->num_threads = 0;
+  threads->rt_config = rt_config;
+  threads->run.store(true);
+  initialize_cycle_histogram(&threads->shared_ns);
+  initialize_cycle_histogram(&threads->wait_ns);
+}
+
+/**
+ * @param cpu cpu the thread of the robot is pinned to, -1 for the helper cpus
+ * @param on_control_thread run the robot on the control thread instead of a
+ *                          thread of its own
+ */
+inline int add_robot_thread(RobotThreads *threads, const char *name, int cpu,
+                            bool on_control_thread, std::function<void()> sense,
+                            std::function<void()> act)
+{
+  if (threads->num_threads >= ROBOT_THREADS_MAX)
+  {
+    printf("Too many robot threads, not adding %s\n", name);
+    return -1;
+  }
+
+  RobotThread *thread = &threads->threads[threads->num_threads];
+  thread->name = name;
+  thread->cpu = cpu;
+  thread->on_control_thread = on_control_thread;
+  thread->sense = sense;
+  thread->act = act;
+  thread->threads = threads;
+  initialize_cycle_histogram(&thread->sense_ns);
+  initialize_cycle_histogram(&thread->act_ns);
+
+  return threads->num_threads++;
+}
+
+inline void run_robot_thread_sense(RobotThread *thread)
+{
+  int64_t start_ns = cycle_scheduler_now_ns();
+  thread->sense();
+  record_cycle_histogram(&thread->sense_ns, cycle_scheduler_now_ns() - start_ns);
+}
+
+inline void run_robot_thread_act(RobotThread *thread)
+{
+  int64_t start_ns = cycle_scheduler_now_ns();
+  thread->act();
+  record_cycle_histogram(&thread->act_ns, cycle_scheduler_now_ns() - start_ns);
+}
+
+inline int set_robot_thread_affinity(const RobotThread *thread)
+{
+  const RtConfig *rt_config = thread->threads->rt_config;
+
+  if (thread->cpu >= 0)
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(thread->cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  }
+
+  return rt_config != NULL ? set_rt_helper_affinity(rt_config) : 0;
+}
+
+inline void *robot_thread(void *arg)
+{
+  RobotThread *thread = (RobotThread *)arg;
+  RobotThreads *threads = thread->threads;
+
+  // threads inherit the affinity of the control thread
+  if (set_robot_thread_affinity(thread) != 0)
+  {
+    printf("Failed to pin the thread of %s\n", thread->name);
+  }
+
+  while (true)
+  {
+    spin_barrier_wait(&threads->barrier);  // start
+    if (!threads->run.load(std::memory_order_relaxed))
+    {
+      break;
+    }
+
+    run_robot_thread_sense(thread);
+    spin_barrier_wait(&threads->barrier);  // sensed
+
+    spin_barrier_wait(&threads->barrier);  // shared done
+    run_robot_thread_act(thread);
+    spin_barrier_wait(&threads->barrier);  // done
+  }
+
+  return NULL;
+}
+
+/**
+ * Starts the threads, after apply_rt_config so that they inherit the
+ * scheduling policy of the control thread.
+ */
+inline void start_robot_threads(RobotThreads *threads)
+{
+  int num_barrier_threads = 1;
+  for (int i = 0; i < threads->num_threads; i++)
+  {
+    num_barrier_threads += threads->threads[i].on_control_thread ? 0 : 1;
+  }
+  initialize_spin_barrier(&threads->barrier, num_barrier_threads);
+
+  for (int i = 0; i < threads->num_threads; i++)
+  {
+    RobotThread *thread = &threads->threads[i];
+    if (thread->on_control_thread)
+    {
+      continue;
+    }
+    if (pthread_create(&thread->thread, NULL, robot_thread, thread) != 0)
+    {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+}
+
+/**
+ * Starts a cycle and returns once all robots acquired their samples, the
+ * robots are free for the part of the loop that needs all of them.
+ */
+inline void robot_threads_sense(RobotThreads *threads)
+{
+  spin_barrier_wait(&threads->barrier);  // start
+
+  for (int i = 0; i < threads->num_threads; i++)
+  {
+    if (threads->threads[i].on_control_thread)
+    {
+      run_robot_thread_sense(&threads->threads[i]);
+    }
+  }
+
+  spin_barrier_wait(&threads->barrier);  // sensed
+}
+
+/**
+ * Releases the robot threads into their compute and actuation and returns
+ * once all robots are commanded.
+ *
+ * @param shared_start_ns instant the control thread started the shared part
+ */
+inline void robot_threads_act(RobotThreads *threads, int64_t shared_start_ns)
+{
+  record_cycle_histogram(&threads->shared_ns, cycle_scheduler_now_ns() - shared_start_ns);
+  spin_barrier_wait(&threads->barrier);  // shared done
+
+  for (int i = 0; i < threads->num_threads; i++)
+  {
+    if (threads->threads[i].on_control_thread)
+    {
+      run_robot_thread_act(&threads->threads[i]);
+    }
+  }
+
+  int64_t wait_start_ns = cycle_scheduler_now_ns();
+  spin_barrier_wait(&threads->barrier);  // done
+  record_cycle_histogram(&threads->wait_ns, cycle_scheduler_now_ns() - wait_start_ns);
+}
+
+/**
+ * To be called between cycles, i.e. not between robot_threads_sense and
+ * robot_threads_act.
+ */
+inline void stop_robot_threads(RobotThreads *threads)
+{
+  threads->run.store(false, std::memory_order_relaxed);
+  spin_barrier_wait(&threads->barrier);  // start, the robot threads see run and exit
+
+  for (int i = 0; i < threads->num_threads; i++)
+  {
+    if (!threads->threads[i].on_control_thread)
+    {
+      pthread_join(threads->threads[i].thread, NULL);
+    }
+  }
+}
+
+inline void print_robot_threads_report(FILE *file, const RobotThreads *threads)
+{
+  for (int i = 0; i < threads->num_threads; i++)
+  {
+    const RobotThread *thread = &threads->threads[i];
+    fprintf(file, "robot thread %s%s\n", thread->name,
+            thread->on_control_thread ? " (control thread)" : "");
+    print_cycle_histogram_summary(file, "sense", &thread->sense_ns);
+    print_cycle_histogram_summary(file, "act", &thread->act_ns);
+  }
+  print_cycle_histogram_summary(file, "shared", &threads->shared_ns);
+  print_cycle_histogram_summary(file, "wait", &threads->wait_ns);
+}
+
+#endif  // ROBOT_THREADS_HPP
@@ -0,0 +1,313 @@
+#ifndef RT_SETUP_HPP
+#define RT_SETUP_HPP
+
+#include <alloca.h>
+#include <dirent.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define RT_MAX_HELPER_CPUS 16
+
+/**
+ * Real-time configuration of the process, filled from the `rt` section of the
+ * motion spec IR.
+ */
+struct RtConfig
+{
+  int policy;        // SCHED_FIFO, SCHED_RR or SCHED_OTHER
+  int priority;      // 1..99 for the real-time policies
+  int control_cpu;   // cpu the control thread is pinned to, -1 to not pin
+  int helper_cpus[RT_MAX_HELPER_CPUS];  // cpus for every other thread
+  int num_helper_cpus;
+  bool lock_memory;            // mlockall(MCL_CURRENT | MCL_FUTURE)
+  size_t prefault_stack_size;  // [bytes]
+  size_t prefault_heap_size;   // [bytes]
+};
+
+/**
+ * What was actually applied by apply_rt_config. A failing step is recorded
+ * with its errno and does not stop the remaining steps.
+ */
+struct RtReport
+{
+  int policy_error;
+  int control_affinity_error;
+  int helper_threads_pinned;
+  int helper_affinity_errors;
+  int lock_memory_error;
+  size_t prefaulted_stack;
+  size_t prefaulted_heap;
+  bool control_cpu_isolated;
+};
+
+inline const char *rt_policy_name(int policy)
+{
+  switch (policy)
+  {
+    case SCHED_FIFO:
+      return "SCHED_FIFO";
+    case SCHED_RR:
+      return "SCHED_RR";
+    case SCHED_OTHER:
+      return "SCHED_OTHER";
+    default:
+      return "unknown";
+  }
+}
+
+/**
+ * Checks if the cpu is listed in /sys/devices/system/cpu/isolated, i.e. was
+ * removed from the scheduler with the isolcpus kernel parameter.
+ */
+inline bool is_cpu_isolated(int cpu)
+{
+  FILE *file = fopen("/sys/devices/system/cpu/isolated", "r");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  char cpu_list[256] = {};
+  if (fgets(cpu_list, sizeof(cpu_list), file) == NULL)
+  {
+    fclose(file);
+    return false;
+  }
+  fclose(file);
+
+  // the list has the form "2-3,6"
+  char *save_ptr = NULL;
+  for (char *range = strtok_r(cpu_list, ",\n", &save_ptr); range != NULL;
+       range = strtok_r(NULL, ",\n", &save_ptr))
+  {
+    int first = -1;
+    int last = -1;
+    int n = sscanf(range, "%d-%d", &first, &last);
+    if (n == 1)
+    {
+      last = first;
+    }
+    if (n >= 1 && cpu >= first && cpu <= last)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline void rt_helper_cpu_set(const RtConfig *config, cpu_set_t *cpu_set)
+{
+  CPU_ZERO(cpu_set);
+  for (int i = 0; i < config->num_helper_cpus; i++)
+  {
+    CPU_SET(config->helper_cpus[i], cpu_set);
+  }
+}
+
+/**
+ * Pins the calling thread to the helper cpus. To be called at the start of
+ * threads that are spawned after apply_rt_config, as they inherit the
+ * affinity of the control thread otherwise.
+ */
+inline int set_rt_helper_affinity(const RtConfig *config)
+{
+  if (config->num_helper_cpus == 0)
+  {
+    return 0;
+  }
+
+  cpu_set_t cpu_set;
+  rt_helper_cpu_set(config, &cpu_set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+}
+
+/**
+ * Gives the calling thread the scheduling policy and priority of the control
+ * thread, for threads the control thread waits on or hands its commands to.
+ */
+inline int set_rt_thread_policy(const RtConfig *config)
+{
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = config->policy == SCHED_OTHER ? 0 : config->priority;
+  return pthread_setschedparam(pthread_self(), config->policy, &param);
+}
+
+/**
+ * Moves all other threads of the process (e.g. the ones started by the
+ * kinova api) to the helper cpus.
+ */
+inline void pin_rt_helper_threads(const RtConfig *config, RtReport *report)
+{
+  if (config->num_helper_cpus == 0)
+  {
+    return;
+  }
+
+  cpu_set_t cpu_set;
+  rt_helper_cpu_set(config, &cpu_set);
+
+  pid_t self = (pid_t)syscall(SYS_gettid);
+
+  DIR *tasks = opendir("/proc/self/task");
+  if (tasks == NULL)
+  {
+    report->helper_affinity_errors++;
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(tasks)) != NULL)
+  {
+    pid_t tid = (pid_t)atoi(entry->d_name);
+    if (tid <= 0 || tid == self)
+    {
+      continue;
+    }
+
+    if (sched_setaffinity(tid, sizeof(cpu_set), &cpu_set) == 0)
+    {
+      report->helper_threads_pinned++;
+    }
+    else
+    {
+      report->helper_affinity_errors++;
+    }
+  }
+
+  closedir(tasks);
+}
+
+/**
+ * Touches the given amount of stack so that the pages are mapped (and locked
+ * with mlockall) before the control loop starts.
+ *
+ * One byte per page is written through a volatile pointer into a single
+ * frame, from the top of the frame downwards; the stores must not be
+ * optimized away, the frame is dead once the function returns.
+ */
+__attribute__((noinline)) inline size_t prefault_stack(size_t size)
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  volatile unsigned char *stack = (volatile unsigned char *)alloca(size);
+
+  for (size_t offset = 0; offset < size; offset += page_size)
+  {
+    stack[size - 1 - offset] = 0;
+  }
+  asm volatile("" : : "r"(stack) : "memory");
+
+  return size;
+}
+
+/**
+ * Maps the given amount of heap and hands it back to malloc without returning
+ * it to the kernel, so later allocations in the loop do not page-fault.
+ */
+inline size_t prefault_heap(size_t size)
+{
+  // keep freed memory in the process and serve large blocks from the heap
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  unsigned char *buffer = (unsigned char *)malloc(size);
+  if (buffer == NULL)
+  {
+    return 0;
+  }
+
+  // through a volatile pointer, else malloc, the stores and free may be elided together
+  volatile unsigned char *pages = buffer;
+  long page_size = sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < size; i += page_size)
+  {
+    pages[i] = 0;
+  }
+  free(buffer);
+
+  return size;
+}
+
+/**
+ * Applies the real-time configuration to the calling (control) thread and
+ * the process. Must be called from the thread that runs the control loop.
+ */
+inline void apply_rt_config(const RtConfig *config, RtReport *report)
+{
+  memset(report, 0, sizeof(RtReport));
+
+  // memory
+  if (config->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    report->lock_memory_error = errno;
+  }
+  if (config->prefault_heap_size > 0)
+  {
+    report->prefaulted_heap = prefault_heap(config->prefault_heap_size);
+  }
+  if (config->prefault_stack_size > 0)
+  {
+    report->prefaulted_stack = prefault_stack(config->prefault_stack_size);
+  }
+
+  // affinity
+  pin_rt_helper_threads(config, report);
+
+  if (config->control_cpu >= 0)
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(config->control_cpu, &cpu_set);
+    report->control_affinity_error =
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    report->control_cpu_isolated = is_cpu_isolated(config->control_cpu);
+  }
+
+  // scheduling
+  report->policy_error = set_rt_thread_policy(config);
+}
+
+inline void print_rt_report(const RtConfig *config, const RtReport *report)
+{
+  printf("real-time setup:\n");
+  printf("  scheduling: %s, priority %d: %s\n", rt_policy_name(config->policy),
+         config->priority, report->policy_error ? strerror(report->policy_error) : "ok");
+
+  if (config->control_cpu >= 0)
+  {
+    printf("  control thread cpu: %d: %s\n", config->control_cpu,
+           report->control_affinity_error ? strerror(report->control_affinity_error) : "ok");
+    if (!report->control_cpu_isolated)
+    {
+      printf("  WARNING: cpu %d is not isolated (isolcpus), other tasks may preempt the loop\n",
+             config->control_cpu);
+    }
+  }
+
+  if (config->num_helper_cpus > 0)
+  {
+    printf("  helper threads pinned: %d, failed: %d\n", report->helper_threads_pinned,
+           report->helper_affinity_errors);
+  }
+
+  if (config->lock_memory)
+  {
+    printf("  mlockall: %s\n",
+           report->lock_memory_error ? strerror(report->lock_memory_error) : "ok");
+  }
+
+  printf("  prefaulted stack: %zu kB, heap: %zu kB\n", report->prefaulted_stack / 1024,
+         report->prefaulted_heap / 1024);
+}
+
+#endif  // RT_SETUP_HPP
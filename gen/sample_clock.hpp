@@ -0,0 +1,101 @@
+#ifndef SAMPLE_CLOCK_HPP
+#define SAMPLE_CLOCK_HPP
+
+#include <cstdint>
+#include <cstdio>
+
+#include "cycle_scheduler.hpp"
+
+/**
+ * Acquisition time of the samples of one data source (an arm, the base).
+ *
+ * Every sample is stamped at the midpoint of the request and the reply of
+ * its acquisition, and `dt` is the interval between the last two samples of
+ * the source. Controllers and the base odometry integrate over `dt` instead
+ * of the period of the loop, so a late or early acquisition does not skew
+ * their integral and derivative terms.
+ *
+ * `dt` is clamped to `max_dt`, so a stalled source does not wind up the
+ * integrators, and falls back to the nominal period for the first sample.
+ */
+struct SampleClock
+{
+  double nominal_dt;  // s
+  double max_dt;      // s
+
+  int64_t request_ns;     // instant the current acquisition was requested
+  int64_t stamp_ns;       // acquisition instant of the last sample
+  int64_t prev_stamp_ns;  // acquisition instant of the sample before
+
+  double dt;  // s, interval between the last two samples
+
+  long samples;
+  long clamped;  // samples whose interval exceeded max_dt
+};
+
+inline void initialize_sample_clock(SampleClock *clock, double nominal_dt, double max_dt)
+{
+  clock->nominal_dt = nominal_dt;
+  clock->max_dt = max_dt;
+  clock->request_ns = 0;
+  clock->stamp_ns = 0;
+  clock->prev_stamp_ns = 0;
+  clock->dt = nominal_dt;
+  clock->samples = 0;
+  clock->clamped = 0;
+}
+
+/**
+ * Stamps a sample with an acquisition instant on the CLOCK_MONOTONIC time
+ * base, e.g. one provided by the source itself.
+ */
+inline void sample_clock_stamp_at(SampleClock *clock, int64_t stamp_ns)
+{
+  clock->prev_stamp_ns = clock->stamp_ns;
+  clock->stamp_ns = stamp_ns;
+
+  if (clock->samples++ == 0)
+  {
+    clock->dt = clock->nominal_dt;
+    return;
+  }
+
+  double dt = (double)(clock->stamp_ns - clock->prev_stamp_ns) / NS_PER_SECOND;
+  if (dt <= 0.0)
+  {
+    // the source delivered its previous sample again
+    dt = clock->nominal_dt;
+  }
+  else if (dt > clock->max_dt)
+  {
+    dt = clock->max_dt;
+    clock->clamped++;
+  }
+  clock->dt = dt;
+}
+
+/**
+ * To be called right before the acquisition of a sample.
+ */
+inline void sample_clock_request(SampleClock *clock)
+{
+  clock->request_ns = cycle_scheduler_now_ns();
+}
+
+/**
+ * To be called right after the acquisition of a sample, stamps it at the
+ * midpoint of the request and the reply.
+ */
+inline void sample_clock_stamp(SampleClock *clock)
+{
+  int64_t reply_ns = cycle_scheduler_now_ns();
+  sample_clock_stamp_at(clock, clock->request_ns + (reply_ns - clock->request_ns) / 2);
+}
+
+inline void print_sample_clock_report(FILE *file, const char *name, const SampleClock *clock)
+{
+  fprintf(file, "%s samples: %ld, intervals clamped to %.3f ms: %ld\n", name, clock->samples,
+          clock->max_dt * 1e3, clock->clamped);
+}
+
+#endif  // SAMPLE_CLOCK_HPP
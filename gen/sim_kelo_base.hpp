@@ -0,0 +1,135 @@
+#ifndef SIM_KELO_BASE_HPP
+#define SIM_KELO_BASE_HPP
+
+#include <cstdio>
+#include <cstring>
+
+#include <motion_spec_utils/utils.hpp>
+
+#include "base_state_view.hpp"
+#include "cycle_scheduler.hpp"
+#include "virtual_kelo_ethercat.hpp"
+
+/**
+ * Stand-in for the Kelo base of the generated loops in sim mode, where the
+ * EtherCAT segment is never connected. The platform is the one of the virtual
+ * Kelo drives (virtual_kelo_ethercat.hpp), driven by the commanded wheel
+ * torques directly instead of the command PDOs.
+ *
+ * get_robot_data still reads the base through its unconnected EtherCAT
+ * configuration, write_sim_kelo_base_state overwrites the measurements and the
+ * odometry in the MobileBaseState with the simulated ones afterwards, as the
+ * mirrored base of a split process is overwritten with the state of the peer.
+ */
+struct SimKeloBase
+{
+  VirtualKeloEthercat drives;  // platform dynamics only, no fieldbus
+  long feedback_requests;
+  long torque_commands;
+};
+
+/**
+ * @param config geometry of the base, the pivots at its wheel_coordinates
+ */
+inline void initialize_sim_kelo_base(SimKeloBase *base, const KeloBaseConfig *config)
+{
+  double pivot_offsets[VIRTUAL_KELO_MAX_DRIVES] = {};
+  initialize_virtual_kelo_platform(&base->drives.platform, config->nWheels,
+                                   config->wheel_coordinates, pivot_offsets, config->radius,
+                                   config->castor_offset, config->half_wheel_distance);
+
+  base->drives.ecat = NULL;
+  base->drives.started = false;
+  base->drives.updates = 0;
+  memset(base->drives.pose, 0, sizeof(base->drives.pose));
+  memset(base->drives.twist, 0, sizeof(base->drives.twist));
+  memset(base->drives.pivot_angles, 0, sizeof(base->drives.pivot_angles));
+  memset(base->drives.pivot_rates, 0, sizeof(base->drives.pivot_rates));
+  memset(base->drives.wheel_angles, 0, sizeof(base->drives.wheel_angles));
+  memset(base->drives.wheel_rates, 0, sizeof(base->drives.wheel_rates));
+  memset(base->drives.wheel_torques, 0, sizeof(base->drives.wheel_torques));
+
+  base->feedback_requests = 0;
+  base->torque_commands = 0;
+}
+
+/**
+ * Starts the simulated time of the platform, it stands still until then.
+ */
+inline void start_sim_kelo_base(SimKeloBase *base)
+{
+  base->drives.started = true;
+  base->drives.start_ns = cycle_scheduler_now_ns();
+  base->drives.last_update_ns = base->drives.start_ns;
+}
+
+/**
+ * Integrates the platform up to now, in place of update_base_state.
+ */
+inline void update_sim_kelo_base(SimKeloBase *base)
+{
+  if (base->drives.started)
+  {
+    virtual_kelo_ethercat_integrate(&base->drives, cycle_scheduler_now_ns());
+  }
+  base->drives.updates++;
+  base->feedback_requests++;
+}
+
+/**
+ * In place of set_kelo_base_torques: the torques act on the platform from
+ * now on.
+ *
+ * @param torques [Nm] two per drive, in the order of the wheel coordinates
+ */
+inline void set_sim_kelo_base_torques(SimKeloBase *base, const double *torques)
+{
+  if (base->drives.started)
+  {
+    virtual_kelo_ethercat_integrate(&base->drives, cycle_scheduler_now_ns());
+  }
+  for (int i = 0; i < 2 * base->drives.platform.num_drives; i++)
+  {
+    base->drives.wheel_torques[i] = torques[i];
+  }
+  base->torque_commands++;
+}
+
+/**
+ * Overwrites the measurements and the odometry of the base after
+ * get_robot_data with the state of the simulated platform.
+ */
+inline void write_sim_kelo_base_state(const SimKeloBase *base, MobileBaseState *state)
+{
+  BaseStateView view;
+  view.num_drives = base->drives.platform.num_drives;
+  view.pivot_angles = base->drives.pivot_angles;
+  view.pivot_velocities = base->drives.pivot_rates;
+  view.wheel_positions = base->drives.wheel_angles;
+  view.wheel_velocities = base->drives.wheel_rates;
+  view.wheel_coordinates = NULL;
+  write_mobile_base_state(&view, state);
+
+  for (int i = 0; i < 3; i++)
+  {
+    state->x_platform[i] = base->drives.pose[i];
+    state->xd_platform[i] = base->drives.twist[i];
+  }
+}
+
+/**
+ * The feedback requests per cycle show that the base is only updated once
+ * per cycle.
+ */
+inline void print_sim_kelo_base_report(FILE *file, const char *name, const SimKeloBase *base,
+                                       long cycles)
+{
+  fprintf(file, "simulated %s: %ld feedback requests in %ld cycles (%.2f per cycle)\n", name,
+          base->feedback_requests, cycles,
+          cycles > 0 ? (double)base->feedback_requests / (double)cycles : 0.0);
+  fprintf(file, "simulated %s: %ld torque commands, platform at x: %.3f m, y: %.3f m, "
+          "yaw: %.3f rad\n", name, base->torque_commands, base->drives.pose[0],
+          base->drives.pose[1], base->drives.pose[2]);
+}
+
+#endif  // SIM_KELO_BASE_HPP
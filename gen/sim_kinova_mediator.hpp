@@ -0,0 +1,302 @@
+#ifndef SIM_KINOVA_MEDIATOR_HPP
+#define SIM_KINOVA_MEDIATOR_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include <kdl/chain.hpp>
+#include <kdl/chaindynparam.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/jntspaceinertiamatrix.hpp>
+#include <kdl/tree.hpp>
+#include <kdl_parser/kdl_parser.hpp>
+#include <kinova_mediator/mediator.hpp>
+
+#include "cycle_histogram.hpp"
+#include "cycle_scheduler.hpp"
+
+#define SIM_KINOVA_NUM_JOINTS 7
+#define SIM_KINOVA_MAX_STEP 0.0005   // s, longest integration step
+#define SIM_KINOVA_SPIN_NS 20000     // busy-wait at the end of a simulated round trip
+
+enum SimLatencyDistribution
+{
+  SIM_LATENCY_CONSTANT,
+  SIM_LATENCY_UNIFORM,
+  SIM_LATENCY_NORMAL,
+  SIM_LATENCY_LOGNORMAL,
+};
+
+/**
+ * Round-trip time of a request to a simulated arm.
+ */
+struct SimLatencyModel
+{
+  SimLatencyDistribution distribution;
+  double mean_us;
+  double jitter_us;          // standard deviation, half width of the uniform distribution
+  double spike_probability;  // probability of an additional delay per round trip
+  double spike_us;
+};
+
+struct SimKinovaConfig
+{
+  SimLatencyModel latency;
+  double joint_damping;  // Nms/rad, viscous friction of every joint
+  double initial_positions[SIM_KINOVA_NUM_JOINTS];  // rad
+  unsigned int seed;
+};
+
+inline int64_t sample_sim_latency_ns(const SimLatencyModel *model, std::mt19937 *rng)
+{
+  double us = model->mean_us;
+
+  switch (model->distribution)
+  {
+    case SIM_LATENCY_CONSTANT:
+      break;
+    case SIM_LATENCY_UNIFORM:
+      us = std::uniform_real_distribution<double>(model->mean_us - model->jitter_us,
+                                                  model->mean_us + model->jitter_us)(*rng);
+      break;
+    case SIM_LATENCY_NORMAL:
+      us = std::normal_distribution<double>(model->mean_us, model->jitter_us)(*rng);
+      break;
+    case SIM_LATENCY_LOGNORMAL:
+    {
+      // parameters of the underlying normal distribution for the given mean and deviation
+      double sigma2 = std::log(1.0 + std::pow(model->jitter_us / model->mean_us, 2));
+      us = std::lognormal_distribution<double>(std::log(model->mean_us) - sigma2 / 2,
+                                               std::sqrt(sigma2))(*rng);
+      break;
+    }
+  }
+
+  if (model->spike_probability > 0.0 &&
+      std::bernoulli_distribution(model->spike_probability)(*rng))
+  {
+    us += model->spike_us;
+  }
+
+  return us > 0.0 ? (int64_t)(us * 1e3) : 0;
+}
+
+/**
+ * Stand-in for the Kinova Gen3 mediator that needs no arm on the network.
+ *
+ * The joint dynamics of the arm are integrated from the urdf: the commanded
+ * torques act against gravity, the Coriolis and centrifugal torques and a
+ * viscous joint friction. The arm holds its initial pose until the first
+ * torque command or the switch to torque control. Every request to the arm
+ * (refresh_feedback, set_joint_torques) blocks for a round trip sampled from
+ * the latency model, so the generated loops see realistic I/O times.
+ *
+ * motion_spec_utils reads the joint state through the virtual interface of
+ * the mediator, refresh_feedback is called on the concrete type by the
+ * generated code.
+ */
+class sim_kinova_mediator : public kinova_mediator
+{
+ public:
+  explicit sim_kinova_mediator(const SimKinovaConfig &config)
+      : config(config),
+        rng(config.seed),
+        q(SIM_KINOVA_NUM_JOINTS),
+        qd(SIM_KINOVA_NUM_JOINTS),
+        tau(SIM_KINOVA_NUM_JOINTS),
+        q_feedback(SIM_KINOVA_NUM_JOINTS),
+        qd_feedback(SIM_KINOVA_NUM_JOINTS),
+        tau_feedback(SIM_KINOVA_NUM_JOINTS)
+  {
+    for (int i = 0; i < SIM_KINOVA_NUM_JOINTS; i++)
+    {
+      q(i) = config.initial_positions[i];
+    }
+    q_feedback = q;
+    initialize_cycle_histogram(&round_trips);
+    feedback_requests = 0;
+  }
+
+  ~sim_kinova_mediator() { delete dynamics; }
+
+  /**
+   * Loads the dynamics of the chain between the base and the tool frame.
+   * Gravity is expressed in the base frame from its pose w.r.t. the world
+   * frame, i.e. the mounting of the arm on the robot.
+   */
+  bool load_model(const std::string &urdf, const std::string &world_frame,
+                  const std::string &base_frame, const std::string &tool_frame)
+  {
+    KDL::Tree tree;
+    if (!kdl_parser::treeFromFile(urdf, tree) || !tree.getChain(base_frame, tool_frame, chain))
+    {
+      printf("Failed to load the simulated arm %s -> %s from %s\n", base_frame.c_str(),
+             tool_frame.c_str(), urdf.c_str());
+      return false;
+    }
+
+    KDL::Vector gravity(0.0, 0.0, -9.81);
+    KDL::Chain mounting;
+    if (tree.getChain(world_frame, base_frame, mounting))
+    {
+      KDL::ChainFkSolverPos_recursive fk(mounting);
+      KDL::JntArray fixed(mounting.getNrOfJoints());
+      KDL::Frame base_pose;
+      fk.JntToCart(fixed, base_pose);
+      gravity = base_pose.M.Inverse() * gravity;
+    }
+
+    delete dynamics;
+    dynamics = new KDL::ChainDynParam(chain, gravity);
+    mass = KDL::JntSpaceInertiaMatrix(chain.getNrOfJoints());
+    coriolis = KDL::JntArray(chain.getNrOfJoints());
+    gravity_torques = KDL::JntArray(chain.getNrOfJoints());
+
+    last_ns = cycle_scheduler_now_ns();
+    return true;
+  }
+
+  void initialize(const int robot_model, const int robot_id, const double DT) override
+  {
+    last_ns = cycle_scheduler_now_ns();
+  }
+
+  int set_control_mode(const int desired_control_mode) override
+  {
+    integrate(cycle_scheduler_now_ns());
+    torque_control = desired_control_mode == 2;
+    return 0;
+  }
+
+  void get_joint_state(KDL::JntArray &joint_positions, KDL::JntArray &joint_velocities,
+                       KDL::JntArray &joint_torques) override
+  {
+    joint_positions = q_feedback;
+    joint_velocities = qd_feedback;
+    joint_torques = tau_feedback;
+  }
+
+  void get_joint_positions(KDL::JntArray &joint_positions) override
+  {
+    joint_positions = q_feedback;
+  }
+
+  void get_joint_velocities(KDL::JntArray &joint_velocities) override
+  {
+    joint_velocities = qd_feedback;
+  }
+
+  void get_joint_torques(KDL::JntArray &joint_torques) override { joint_torques = tau_feedback; }
+
+  int set_joint_torques(const KDL::JntArray &joint_torques) override
+  {
+    integrate(cycle_scheduler_now_ns());
+    tau = joint_torques;
+    torque_control = true;
+    round_trip();
+    return 0;
+  }
+
+  /**
+   * Integrates the arm up to the instant the feedback is sampled and blocks
+   * for the rest of the round trip.
+   */
+  void refresh_feedback()
+  {
+    integrate(cycle_scheduler_now_ns());
+    q_feedback = q;
+    qd_feedback = qd;
+    tau_feedback = tau;
+    feedback_requests++;
+    round_trip();
+  }
+
+  /**
+   * One feedback request per cycle: the io workers exchange with the arm,
+   * get_robot_data only reads the feedback cached by the last request.
+   */
+  void print_report(FILE *file, const char *name, long cycles) const
+  {
+    fprintf(file, "simulated %s: %ld feedback requests in %ld cycles (%.2f per cycle)\n", name,
+            feedback_requests, cycles,
+            cycles > 0 ? (double)feedback_requests / (double)cycles : 0.0);
+    fprintf(file, "simulated %s ", name);
+    print_cycle_histogram_summary(file, "rtt", &round_trips);
+  }
+
+ private:
+  void integrate(int64_t until_ns)
+  {
+    if (dynamics == NULL || !torque_control)
+    {
+      last_ns = until_ns;
+      return;
+    }
+
+    double remaining = (double)(until_ns - last_ns) / NS_PER_SECOND;
+    last_ns = until_ns;
+
+    while (remaining > 0.0)
+    {
+      double step = remaining < SIM_KINOVA_MAX_STEP ? remaining : SIM_KINOVA_MAX_STEP;
+      remaining -= step;
+
+      dynamics->JntToMass(q, mass);
+      dynamics->JntToCoriolis(q, qd, coriolis);
+      dynamics->JntToGravity(q, gravity_torques);
+
+      Eigen::VectorXd net =
+          tau.data - coriolis.data - gravity_torques.data - config.joint_damping * qd.data;
+      Eigen::VectorXd qdd = mass.data.ldlt().solve(net);
+
+      // semi-implicit Euler
+      qd.data += qdd * step;
+      q.data += qd.data * step;
+    }
+  }
+
+  void round_trip()
+  {
+    int64_t start_ns = cycle_scheduler_now_ns();
+    int64_t end_ns = start_ns + sample_sim_latency_ns(&config.latency, &rng);
+
+    if (end_ns - start_ns > SIM_KINOVA_SPIN_NS)
+    {
+      cycle_scheduler_sleep_until(end_ns - SIM_KINOVA_SPIN_NS);
+    }
+    while (cycle_scheduler_now_ns() < end_ns)
+    {
+    }
+
+    record_cycle_histogram(&round_trips, cycle_scheduler_now_ns() - start_ns);
+  }
+
+  SimKinovaConfig config;
+  std::mt19937 rng;
+
+  KDL::Chain chain;
+  KDL::ChainDynParam *dynamics = NULL;
+  KDL::JntSpaceInertiaMatrix mass;
+  KDL::JntArray coriolis;
+  KDL::JntArray gravity_torques;
+
+  bool torque_control = false;
+  int64_t last_ns = 0;  // instant the state was integrated to
+
+  KDL::JntArray q;
+  KDL::JntArray qd;
+  KDL::JntArray tau;  // commanded
+
+  KDL::JntArray q_feedback;
+  KDL::JntArray qd_feedback;
+  KDL::JntArray tau_feedback;
+
+  CycleHistogram round_trips;  // [ns]
+  long feedback_requests;
+};
+
+#endif  // SIM_KINOVA_MEDIATOR_HPP
@@ -0,0 +1,221 @@
+#ifndef SOLVER_WORKER_HPP
+#define SOLVER_WORKER_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+#include "cycle_histogram.hpp"
+#include "cycle_scheduler.hpp"
+#include "rt_setup.hpp"
+#include "spin_barrier.hpp"
+
+/**
+ * Persistent thread that runs a part of the solver stage, the solvers of one
+ * arm, while the control thread runs the rest, so that the stage costs the
+ * slower arm instead of both. The solvers of the two parts must not share
+ * state: every arm is swept into its own AchdSweep (achd_sweep.hpp), which
+ * the generator requires for it.
+ *
+ * The worker busy-waits for the forks of the control thread on a cpu of its
+ * own, so that a fork costs a cache line transfer instead of a wake-up, and
+ * the control thread busy-waits for the worker at the join. A waiter that
+ * spun for SPIN_BARRIER_SPINS pauses yields between checks, as at a spin
+ * barrier, so a worker sharing a cpu still progresses.
+ */
+struct SolverWorker
+{
+  const char *name;
+  int cpu;  // -1 for the helper cpus
+  std::function<void()> job;
+  pthread_t thread;
+  const RtConfig *rt_config;
+
+  alignas(SPIN_BARRIER_CACHE_LINE) std::atomic<uint32_t> forked;  // sequence of the last fork
+  int64_t fork_ns;                                                // written before the fork
+  alignas(SPIN_BARRIER_CACHE_LINE) std::atomic<uint32_t> done;    // sequence of the last job
+  std::atomic<bool> run;
+  uint32_t sequence;
+
+  // statistics of the worker
+  CycleHistogram dispatch_ns;  // from the fork to the start of the job
+  CycleHistogram job_ns;
+
+  // statistics of the control thread
+  CycleHistogram control_ns;  // its own part, from the fork to the join
+  CycleHistogram wait_ns;     // at the join, for the worker
+  CycleHistogram stage_ns;    // from the fork to the end of the join
+};
+
+/**
+ * @param cpu cpu the worker is pinned to, -1 for the helper cpus of
+ *            `rt_config`
+ * @param rt_config real-time configuration of the process, NULL to keep the
+ *                  affinity of the control thread
+ */
+inline void initialize_solver_worker(SolverWorker *worker, const char *name, int cpu,
+                                     const RtConfig *rt_config, std::function<void()> job)
+{
+  worker->name = name;
+  worker->cpu = cpu;
+  worker->job = job;
+  worker->rt_config = rt_config;
+  worker->forked.store(0);
+  worker->fork_ns = 0;
+  worker->done.store(0);
+  worker->run.store(true);
+  worker->sequence = 0;
+
+  initialize_cycle_histogram(&worker->dispatch_ns);
+  initialize_cycle_histogram(&worker->job_ns);
+  initialize_cycle_histogram(&worker->control_ns);
+  initialize_cycle_histogram(&worker->wait_ns);
+  initialize_cycle_histogram(&worker->stage_ns);
+}
+
+inline int set_solver_worker_affinity(const SolverWorker *worker)
+{
+  if (worker->cpu >= 0)
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(worker->cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  }
+
+  return worker->rt_config != NULL ? set_rt_helper_affinity(worker->rt_config) : 0;
+}
+
+/**
+ * Spins until `word` differs from `value`, returns its new value.
+ */
+inline uint32_t solver_worker_spin(const std::atomic<uint32_t> *word, uint32_t value)
+{
+  uint32_t current = word->load(std::memory_order_acquire);
+  for (int spins = 0; current == value; spins++)
+  {
+    if (spins < SPIN_BARRIER_SPINS)
+    {
+      spin_barrier_relax();
+    }
+    else
+    {
+      sched_yield();
+    }
+    current = word->load(std::memory_order_acquire);
+  }
+  return current;
+}
+
+inline void *solver_worker_thread(void *arg)
+{
+  SolverWorker *worker = (SolverWorker *)arg;
+
+  // threads inherit the affinity of the control thread
+  if (set_solver_worker_affinity(worker) != 0)
+  {
+    printf("Failed to pin the solver worker %s\n", worker->name);
+  }
+
+  uint32_t done = 0;
+  while (true)
+  {
+    uint32_t forked = solver_worker_spin(&worker->forked, done);
+    if (!worker->run.load(std::memory_order_relaxed))
+    {
+      break;
+    }
+
+    int64_t start_ns = cycle_scheduler_now_ns();
+    record_cycle_histogram(&worker->dispatch_ns, start_ns - worker->fork_ns);
+    worker->job();
+    record_cycle_histogram(&worker->job_ns, cycle_scheduler_now_ns() - start_ns);
+
+    done = forked;
+    worker->done.store(done, std::memory_order_release);
+  }
+
+  return NULL;
+}
+
+/**
+ * Starts the thread, after apply_rt_config so that it inherits the
+ * scheduling policy of the control thread.
+ */
+inline void start_solver_worker(SolverWorker *worker)
+{
+  if (pthread_create(&worker->thread, NULL, solver_worker_thread, worker) != 0)
+  {
+    perror("pthread_create");
+    exit(1);
+  }
+}
+
+/**
+ * Starts the job of the worker for the current cycle, everything the control
+ * thread wrote before is visible to it.
+ */
+inline void solver_worker_fork(SolverWorker *worker)
+{
+  worker->fork_ns = cycle_scheduler_now_ns();
+  worker->forked.store(++worker->sequence, std::memory_order_release);
+}
+
+/**
+ * Waits until the job of the current cycle is done, everything it wrote is
+ * visible to the control thread after.
+ */
+inline void solver_worker_join(SolverWorker *worker)
+{
+  int64_t join_ns = cycle_scheduler_now_ns();
+  record_cycle_histogram(&worker->control_ns, join_ns - worker->fork_ns);
+
+  if (worker->done.load(std::memory_order_acquire) != worker->sequence)
+  {
+    solver_worker_spin(&worker->done, worker->sequence - 1);
+  }
+
+  int64_t end_ns = cycle_scheduler_now_ns();
+  record_cycle_histogram(&worker->wait_ns, end_ns - join_ns);
+  record_cycle_histogram(&worker->stage_ns, end_ns - worker->fork_ns);
+}
+
+/**
+ * To be called between cycles, i.e. not between solver_worker_fork and
+ * solver_worker_join.
+ */
+inline void stop_solver_worker(SolverWorker *worker)
+{
+  worker->run.store(false, std::memory_order_relaxed);
+  worker->forked.store(++worker->sequence, std::memory_order_release);
+  pthread_join(worker->thread, NULL);
+}
+
+/**
+ * The parallel solver stage next to its parts, the median of their sum is
+ * what the stage would cost serially.
+ */
+inline void print_solver_worker_report(FILE *file, const SolverWorker *worker)
+{
+  fprintf(file, "solver worker %s\n", worker->name);
+  print_cycle_histogram_summary(file, "dispatch", &worker->dispatch_ns);
+  print_cycle_histogram_summary(file, "worker", &worker->job_ns);
+  print_cycle_histogram_summary(file, "control", &worker->control_ns);
+  print_cycle_histogram_summary(file, "wait", &worker->wait_ns);
+  print_cycle_histogram_summary(file, "stage", &worker->stage_ns);
+
+  int64_t serial_ns = cycle_histogram_percentile(&worker->job_ns, 50.0) +
+                      cycle_histogram_percentile(&worker->control_ns, 50.0);
+  int64_t stage_ns = cycle_histogram_percentile(&worker->stage_ns, 50.0);
+  if (stage_ns > 0)
+  {
+    fprintf(file, "serial p50: %.3f us, parallel p50: %.3f us, speedup: %.2f\n", serial_ns / 1e3,
+            stage_ns / 1e3, (double)serial_ns / stage_ns);
+  }
+}
+
+#endif  // SOLVER_WORKER_HPP
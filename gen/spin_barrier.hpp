@@ -0,0 +1,70 @@
+#ifndef SPIN_BARRIER_HPP
+#define SPIN_BARRIER_HPP
+
+#include <sched.h>
+#include <atomic>
+#include <cstdint>
+
+#define SPIN_BARRIER_CACHE_LINE 64
+
+// pause instructions before a waiting thread starts yielding its cpu
+#define SPIN_BARRIER_SPINS 20000
+
+/**
+ * Barrier of a fixed set of threads that busy-wait instead of sleeping, for
+ * threads pinned to their own cpus that meet several times per cycle.
+ *
+ * The last thread to arrive resets the count and bumps the generation, the
+ * others spin on the generation. A waiter that spun for SPIN_BARRIER_SPINS
+ * pauses yields between checks, so threads sharing a cpu still progress.
+ */
+struct SpinBarrier
+{
+  alignas(SPIN_BARRIER_CACHE_LINE) std::atomic<uint32_t> arrived;
+  alignas(SPIN_BARRIER_CACHE_LINE) std::atomic<uint32_t> generation;
+  uint32_t num_threads;
+};
+
+inline void initialize_spin_barrier(SpinBarrier *barrier, int num_threads)
+{
+  barrier->arrived.store(0);
+  barrier->generation.store(0);
+  barrier->num_threads = num_threads;
+}
+
+inline void spin_barrier_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * Returns once all threads arrived. Everything a thread wrote before arriving
+ * is visible to all threads after they return.
+ */
+inline void spin_barrier_wait(SpinBarrier *barrier)
+{
+  uint32_t generation = barrier->generation.load(std::memory_order_acquire);
+
+  if (barrier->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == barrier->num_threads)
+  {
+    barrier->arrived.store(0, std::memory_order_relaxed);
+    barrier->generation.store(generation + 1, std::memory_order_release);
+    return;
+  }
+
+  for (int spins = 0; barrier->generation.load(std::memory_order_acquire) == generation; spins++)
+  {
+    if (spins < SPIN_BARRIER_SPINS)
+    {
+      spin_barrier_relax();
+    }
+    else
+    {
+      sched_yield();
+    }
+  }
+}
+
+#endif  // SPIN_BARRIER_HPP
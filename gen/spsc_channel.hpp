@@ -0,0 +1,195 @@
+#ifndef SPSC_CHANNEL_HPP
+#define SPSC_CHANNEL_HPP
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "cycle_scheduler.hpp"
+
+#define SPSC_CHANNEL_CACHE_LINE 64
+
+/**
+ * Wait-free single-producer/single-consumer channel holding the latest
+ * published value, e.g. the torque command for a communication thread or the
+ * state it sends back.
+ *
+ * The value is guarded by a seqlock: the producer makes the sequence odd,
+ * writes the value and makes the sequence even again, the consumer retries a
+ * read that overlapped a write. Neither side ever waits for the other, so a
+ * preempted consumer can not delay the control thread, and a consumer that
+ * falls behind skips to the latest value.
+ *
+ * A waiting consumer spins for a while and then sleeps on a futex on the
+ * sequence. The producer only makes the wake-up syscall if a consumer sleeps.
+ * The sequence, the value and the sleeping flag are on separate cache lines.
+ */
+template <typename T>
+struct SpscChannel
+{
+  static_assert(std::is_trivially_copyable<T>::value, "channel values are copied bytewise");
+
+  alignas(SPSC_CHANNEL_CACHE_LINE) std::atomic<uint32_t> sequence;  // odd while written
+  alignas(SPSC_CHANNEL_CACHE_LINE) T value;
+  alignas(SPSC_CHANNEL_CACHE_LINE) std::atomic<uint32_t> sleeping;
+  std::atomic<bool> closed;
+
+  // statistics, only written by the consumer
+  long reads;
+  long retries;  // reads that overlapped a write
+};
+
+template <typename T>
+inline void initialize_spsc_channel(SpscChannel<T> *channel)
+{
+  channel->sequence.store(0);
+  memset((void *)&channel->value, 0, sizeof(T));
+  channel->sleeping.store(0);
+  channel->closed.store(false);
+  channel->reads = 0;
+  channel->retries = 0;
+}
+
+inline void spsc_channel_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+inline void spsc_channel_futex_wake(std::atomic<uint32_t> *word)
+{
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Publishes a value, never blocks.
+ *
+ * @return sequence number of the value
+ */
+template <typename T>
+inline uint32_t spsc_channel_publish(SpscChannel<T> *channel, const T *value)
+{
+  uint32_t sequence = channel->sequence.load(std::memory_order_relaxed);
+  channel->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  memcpy((void *)&channel->value, value, sizeof(T));
+
+  channel->sequence.store(sequence + 2, std::memory_order_release);
+
+  // orders the store of the sequence before the load of the flag, pairs with
+  // the fence in spsc_channel_wait
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (channel->sleeping.load(std::memory_order_relaxed))
+  {
+    spsc_channel_futex_wake(&channel->sequence);
+  }
+
+  return sequence + 2;
+}
+
+/**
+ * Reads the latest value if it is newer than the one last seen, never blocks.
+ *
+ * @param seen sequence number of the value last read, updated on success
+ * @return true if a newer value was read
+ */
+template <typename T>
+inline bool spsc_channel_read(SpscChannel<T> *channel, T *value, uint32_t *seen)
+{
+  while (true)
+  {
+    uint32_t before = channel->sequence.load(std::memory_order_acquire);
+    if (before == *seen)
+    {
+      return false;
+    }
+    if (before & 1)
+    {
+      channel->retries++;
+      spsc_channel_relax();
+      continue;
+    }
+
+    memcpy((void *)value, (const void *)&channel->value, sizeof(T));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (channel->sequence.load(std::memory_order_relaxed) == before)
+    {
+      *seen = before;
+      channel->reads++;
+      return true;
+    }
+    channel->retries++;
+  }
+}
+
+/**
+ * Waits for a value newer than the one last seen. Spins for `spin_ns` before
+ * sleeping, to skip the wake-up latency of the scheduler for short waits.
+ *
+ * @return false if the channel was closed
+ */
+template <typename T>
+inline bool spsc_channel_wait(SpscChannel<T> *channel, T *value, uint32_t *seen,
+                              int64_t spin_ns)
+{
+  int64_t spin_end_ns = cycle_scheduler_now_ns() + spin_ns;
+
+  while (true)
+  {
+    bool read = spsc_channel_read(channel, value, seen);
+
+    // checked after the read, closing changes the sequence
+    if (channel->closed.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    if (read)
+    {
+      return true;
+    }
+    if (cycle_scheduler_now_ns() < spin_end_ns)
+    {
+      spsc_channel_relax();
+      continue;
+    }
+
+    channel->sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // a value published after announcing the sleep changes the sequence and
+    // the futex returns right away
+    uint32_t sequence = channel->sequence.load(std::memory_order_relaxed);
+    if (sequence == *seen)
+    {
+      syscall(SYS_futex, (uint32_t *)&channel->sequence, FUTEX_WAIT_PRIVATE, sequence, NULL,
+              NULL, 0);
+    }
+
+    channel->sleeping.store(0, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Wakes up the consumer for good, spsc_channel_wait returns false from then
+ * on. To be called by the producer: it changes the sequence, so a consumer
+ * about to sleep does not miss the wake-up.
+ */
+template <typename T>
+inline void close_spsc_channel(SpscChannel<T> *channel)
+{
+  channel->closed.store(true, std::memory_order_relaxed);
+  uint32_t sequence = channel->sequence.load(std::memory_order_relaxed);
+  channel->sequence.store(sequence + 2, std::memory_order_release);
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  spsc_channel_futex_wake(&channel->sequence);
+}
+
+#endif  // SPSC_CHANNEL_HPP
@@ -0,0 +1,206 @@
+#include <pthread.h>
+#include <sched.h>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include "cycle_scheduler.hpp"
+#include "cycle_histogram.hpp"
+#include "rt_setup.hpp"
+#include "spsc_channel.hpp"
+
+/**
+ * Measures the hand-over of a torque command from the control loop to a
+ * communication thread at 1 kHz, through the mutex + condition variable of
+ * the threaded base control (gen/new_old/freddy_*_threaded.cpp) and through
+ * the SpscChannel (spsc_channel.hpp), sleeping and spinning:
+ *
+ *   ./spsc_channel_latency [<cycles> [<control_cpu> <communication_cpu>]]
+ *
+ * `publish` is the time the control thread spends handing over a command,
+ * `wake-up` the time from the hand-over until the communication thread has
+ * read the command.
+ */
+
+#define LATENCY_FREQUENCY 1000.0  // Hz
+
+struct TorqueCommand
+{
+  double tau[8];
+  int64_t publish_ns;
+};
+
+struct HandoverStats
+{
+  CycleHistogram publish;
+  CycleHistogram wake_up;
+};
+
+struct MutexHandover
+{
+  std::mutex data_mutex;
+  std::condition_variable cv;
+  bool run_thread;
+  bool communicate;
+  TorqueCommand command;
+};
+
+void pin_thread(int cpu)
+{
+  if (cpu < 0)
+  {
+    return;
+  }
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+  {
+    printf("Failed to pin thread to cpu %d\n", cpu);
+  }
+}
+
+void print_handover_stats(const char *name, const HandoverStats *stats)
+{
+  printf("%s\n", name);
+  print_cycle_histogram_summary(stdout, "publish", &stats->publish);
+  print_cycle_histogram_summary(stdout, "wake-up", &stats->wake_up);
+}
+
+void measure_mutex(long cycles, int control_cpu, int communication_cpu, HandoverStats *stats)
+{
+  MutexHandover handover;
+  handover.run_thread = true;
+  handover.communicate = false;
+
+  std::thread communication_thread([&]() {
+    pin_thread(communication_cpu);
+    while (true)
+    {
+      std::unique_lock<std::mutex> lk(handover.data_mutex);
+      handover.cv.wait(lk, [&]() { return handover.communicate || !handover.run_thread; });
+      if (!handover.run_thread)
+      {
+        break;
+      }
+      TorqueCommand command = handover.command;
+      handover.communicate = false;
+      lk.unlock();
+
+      record_cycle_histogram(&stats->wake_up, cycle_scheduler_now_ns() - command.publish_ns);
+    }
+  });
+
+  pin_thread(control_cpu);
+  CycleScheduler scheduler;
+  initialize_cycle_scheduler(&scheduler, LATENCY_FREQUENCY, 50e-6);
+
+  for (long i = 0; i < cycles; i++)
+  {
+    cycle_scheduler_begin(&scheduler);
+
+    int64_t start_ns = cycle_scheduler_now_ns();
+    {
+      std::lock_guard<std::mutex> lk(handover.data_mutex);
+      handover.command.tau[0] = (double)i;
+      handover.command.publish_ns = start_ns;
+      handover.communicate = true;
+    }
+    handover.cv.notify_one();
+    record_cycle_histogram(&stats->publish, cycle_scheduler_now_ns() - start_ns);
+
+    cycle_scheduler_wait(&scheduler);
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(handover.data_mutex);
+    handover.run_thread = false;
+  }
+  handover.cv.notify_all();
+  communication_thread.join();
+}
+
+void measure_spsc(long cycles, int control_cpu, int communication_cpu, int64_t spin_ns,
+                  HandoverStats *stats)
+{
+  static SpscChannel<TorqueCommand> channel;
+  initialize_spsc_channel(&channel);
+
+  std::thread communication_thread([&]() {
+    pin_thread(communication_cpu);
+    TorqueCommand command;
+    uint32_t seen = 0;
+    while (spsc_channel_wait(&channel, &command, &seen, spin_ns))
+    {
+      record_cycle_histogram(&stats->wake_up, cycle_scheduler_now_ns() - command.publish_ns);
+    }
+  });
+
+  pin_thread(control_cpu);
+  CycleScheduler scheduler;
+  initialize_cycle_scheduler(&scheduler, LATENCY_FREQUENCY, 50e-6);
+
+  TorqueCommand command = {};
+  for (long i = 0; i < cycles; i++)
+  {
+    cycle_scheduler_begin(&scheduler);
+
+    int64_t start_ns = cycle_scheduler_now_ns();
+    command.tau[0] = (double)i;
+    command.publish_ns = start_ns;
+    spsc_channel_publish(&channel, &command);
+    record_cycle_histogram(&stats->publish, cycle_scheduler_now_ns() - start_ns);
+
+    cycle_scheduler_wait(&scheduler);
+  }
+
+  close_spsc_channel(&channel);
+  communication_thread.join();
+
+  printf("spsc channel reads: %ld, retries: %ld\n", channel.reads, channel.retries);
+}
+
+int main(int argc, char **argv)
+{
+  long cycles = argc > 1 ? atol(argv[1]) : 10000;
+  int control_cpu = argc > 3 ? atoi(argv[2]) : -1;
+  int communication_cpu = argc > 3 ? atoi(argv[3]) : -1;
+
+  // both threads run under the policy of the control loop, the communication
+  // thread inherits it
+  RtConfig rt_config = {};
+  rt_config.policy = SCHED_FIFO;
+  rt_config.priority = 80;
+  rt_config.control_cpu = -1;
+  rt_config.num_helper_cpus = 0;
+  rt_config.lock_memory = true;
+  rt_config.prefault_stack_size = 512 * 1024;
+  rt_config.prefault_heap_size = 0;
+
+  RtReport rt_report;
+  apply_rt_config(&rt_config, &rt_report);
+  print_rt_report(&rt_config, &rt_report);
+
+  static HandoverStats stats[3];
+  for (int i = 0; i < 3; i++)
+  {
+    initialize_cycle_histogram(&stats[i].publish);
+    initialize_cycle_histogram(&stats[i].wake_up);
+  }
+
+  int64_t period_ns = (int64_t)(NS_PER_SECOND / LATENCY_FREQUENCY);
+
+  measure_mutex(cycles, control_cpu, communication_cpu, &stats[0]);
+  measure_spsc(cycles, control_cpu, communication_cpu, 0, &stats[1]);
+  measure_spsc(cycles, control_cpu, communication_cpu, period_ns, &stats[2]);
+
+  printf("%ld cycles at %.0f Hz\n", cycles, LATENCY_FREQUENCY);
+  print_handover_stats("mutex + condition variable", &stats[0]);
+  print_handover_stats("spsc channel, sleeping", &stats[1]);
+  print_handover_stats("spsc channel, spinning", &stats[2]);
+
+  return 0;
+}
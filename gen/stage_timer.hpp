@@ -0,0 +1,182 @@
+#ifndef STAGE_TIMER_HPP
+#define STAGE_TIMER_HPP
+
+/**
+ * Per-stage timing probes of the control loop.
+ *
+ * The probes are only compiled in if MOTION_SPEC_STAGE_TIMING is defined
+ * (see STAGE_TIMING_LEVEL in CMakeLists.txt):
+ *   1: the stages of the loop (robot data, compute variables, controllers,
+ *      embed maps, solvers, command torques)
+ *   2: additionally every solver call
+ * Otherwise all STAGE_* and SOLVER_* macros expand to nothing.
+ */
+
+#if defined(MOTION_SPEC_STAGE_TIMING) && MOTION_SPEC_STAGE_TIMING > 0
+
+#include <time.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "cycle_histogram.hpp"
+
+#define STAGE_TIMERS_MAX 32
+
+struct StageTimer
+{
+  const char *name;
+  CycleHistogram histogram;  // [ns]
+  int64_t sum_ns;
+};
+
+struct StageTimers
+{
+  StageTimer stages[STAGE_TIMERS_MAX];
+  int num_stages;
+  double ns_per_tick;
+};
+
+inline uint64_t stage_timer_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Measures the duration of a tick against CLOCK_MONOTONIC. Only the time
+ * stamp counter needs it, which is assumed to be invariant (constant_tsc).
+ */
+inline double calibrate_stage_timer()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  struct timespec start_ts;
+  struct timespec end_ts;
+  struct timespec sleep_ts = {0, 20000000};  // 20 ms
+
+  clock_gettime(CLOCK_MONOTONIC, &start_ts);
+  uint64_t start_ticks = stage_timer_ticks();
+  nanosleep(&sleep_ts, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end_ts);
+  uint64_t end_ticks = stage_timer_ticks();
+
+  double elapsed_ns =
+      (end_ts.tv_sec - start_ts.tv_sec) * 1e9 + (double)(end_ts.tv_nsec - start_ts.tv_nsec);
+  return elapsed_ns / (double)(end_ticks - start_ticks);
+#else
+  return 1.0;
+#endif
+}
+
+inline void initialize_stage_timers(StageTimers *timers)
+{
+  timers->num_stages = 0;
+  timers->ns_per_tick = calibrate_stage_timer();
+}
+
+inline int add_stage_timer(StageTimers *timers, const char *name)
+{
+  if (timers->num_stages >= STAGE_TIMERS_MAX)
+  {
+    printf("Too many stage timers, not timing %s\n", name);
+    return -1;
+  }
+
+  StageTimer *timer = &timers->stages[timers->num_stages];
+  timer->name = name;
+  timer->sum_ns = 0;
+  initialize_cycle_histogram(&timer->histogram);
+
+  return timers->num_stages++;
+}
+
+inline void record_stage_timer(StageTimers *timers, int stage, uint64_t ticks)
+{
+  if (stage < 0)
+  {
+    return;
+  }
+
+  int64_t ns = (int64_t)(ticks * timers->ns_per_tick);
+  StageTimer *timer = &timers->stages[stage];
+  timer->sum_ns += ns;
+  record_cycle_histogram(&timer->histogram, ns);
+}
+
+inline void print_stage_timers(FILE *file, const StageTimers *timers)
+{
+  fprintf(file, "%-32s %10s %10s %10s %10s %10s %10s\n", "stage [us]", "count", "min", "mean",
+          "p99", "p99.9", "max");
+  for (int i = 0; i < timers->num_stages; i++)
+  {
+    const StageTimer *timer = &timers->stages[i];
+    const CycleHistogram *histogram = &timer->histogram;
+    if (histogram->total == 0)
+    {
+      continue;
+    }
+
+    fprintf(file, "%-32s %10lu %10.3f %10.3f %10.3f %10.3f %10.3f\n", timer->name,
+            (unsigned long)histogram->total, histogram->min / 1e3,
+            (double)timer->sum_ns / histogram->total / 1e3,
+            cycle_histogram_percentile(histogram, 99.0) / 1e3,
+            cycle_histogram_percentile(histogram, 99.9) / 1e3, histogram->max / 1e3);
+  }
+}
+
+inline void write_stage_timers(const StageTimers *timers, const char *log_dir)
+{
+  std::string stage_timing_file = std::string(log_dir) + "/stage_timing.txt";
+  FILE *file = fopen(stage_timing_file.c_str(), "w");
+  if (file != NULL)
+  {
+    print_stage_timers(file, timers);
+    fclose(file);
+  }
+}
+
+#define STAGE_TIMERS_INIT(timers) \
+  static StageTimers timers;      \
+  initialize_stage_timers(&timers)
+#define STAGE_TIMER_REGISTER(timers, stage, name) const int stage = add_stage_timer(&timers, name)
+#define STAGE_PROBE_BEGIN(stage) const uint64_t stage##_start_ticks = stage_timer_ticks()
+#define STAGE_PROBE_END(timers, stage) \
+  record_stage_timer(&timers, stage, stage_timer_ticks() - stage##_start_ticks)
+#define STAGE_TIMERS_REPORT(timers, file) print_stage_timers(file, &timers)
+#define STAGE_TIMERS_WRITE(timers, log_dir) write_stage_timers(&timers, log_dir)
+
+#else
+
+#define STAGE_TIMERS_INIT(timers)
+#define STAGE_TIMER_REGISTER(timers, stage, name)
+#define STAGE_PROBE_BEGIN(stage)
+#define STAGE_PROBE_END(timers, stage)
+#define STAGE_TIMERS_REPORT(timers, file)
+#define STAGE_TIMERS_WRITE(timers, log_dir)
+
+#endif
+
+#if defined(MOTION_SPEC_STAGE_TIMING) && MOTION_SPEC_STAGE_TIMING > 1
+
+#define SOLVER_TIMER_REGISTER(timers, stage, name) STAGE_TIMER_REGISTER(timers, stage, name)
+#define SOLVER_PROBE_BEGIN(stage) STAGE_PROBE_BEGIN(stage)
+#define SOLVER_PROBE_END(timers, stage) STAGE_PROBE_END(timers, stage)
+
+#else
+
+#define SOLVER_TIMER_REGISTER(timers, stage, name)
+#define SOLVER_PROBE_BEGIN(stage)
+#define SOLVER_PROBE_END(timers, stage)
+
+#endif
+
+#endif  // STAGE_TIMER_HPP
@@ -0,0 +1,100 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#define TRIPLE_BUFFER_CACHE_LINE 64
+#define TRIPLE_BUFFER_INDEX 0x3u
+#define TRIPLE_BUFFER_FRESH 0x4u
+
+/**
+ * Wait-free hand-over of the latest value from one writer to one reader
+ * running at different rates, e.g. the measurements of a fieldbus thread to
+ * the control thread.
+ *
+ * The writer fills its back slot and swaps it with the middle one, the reader
+ * swaps its front slot with the middle one if that holds a newer value. Both
+ * only ever exchange an index, so neither waits for the other and a reader
+ * always sees a complete value. Values the reader did not pick up in time are
+ * overwritten by newer ones.
+ */
+template <typename T>
+struct TripleBuffer
+{
+  static_assert(std::is_trivially_copyable<T>::value, "buffered values are copied bytewise");
+
+  struct alignas(TRIPLE_BUFFER_CACHE_LINE) Slot
+  {
+    T value;
+  };
+
+  Slot slots[3];
+
+  alignas(TRIPLE_BUFFER_CACHE_LINE) std::atomic<uint32_t> middle;  // index | TRIPLE_BUFFER_FRESH
+  alignas(TRIPLE_BUFFER_CACHE_LINE) uint32_t back;                 // only used by the writer
+  long published;
+  alignas(TRIPLE_BUFFER_CACHE_LINE) uint32_t front;                // only used by the reader
+  long picked_up;
+};
+
+template <typename T>
+inline void initialize_triple_buffer(TripleBuffer<T> *buffer)
+{
+  memset((void *)buffer->slots, 0, sizeof(buffer->slots));
+  buffer->back = 0;
+  buffer->middle.store(1);
+  buffer->front = 2;
+  buffer->published = 0;
+  buffer->picked_up = 0;
+}
+
+/**
+ * @return the slot to be filled by the writer, it holds an older value
+ */
+template <typename T>
+inline T *triple_buffer_back(TripleBuffer<T> *buffer)
+{
+  return &buffer->slots[buffer->back].value;
+}
+
+/**
+ * Makes the back slot the latest value, never blocks.
+ */
+template <typename T>
+inline void triple_buffer_publish(TripleBuffer<T> *buffer)
+{
+  uint32_t old = buffer->middle.exchange(buffer->back | TRIPLE_BUFFER_FRESH,
+                                         std::memory_order_acq_rel);
+  buffer->back = old & TRIPLE_BUFFER_INDEX;
+  buffer->published++;
+}
+
+/**
+ * Picks up the latest value, never blocks. The returned slot stays valid until
+ * the next call.
+ *
+ * @param fresh set to whether the value was published since the last call,
+ *              may be NULL
+ */
+template <typename T>
+inline const T *triple_buffer_read(TripleBuffer<T> *buffer, bool *fresh)
+{
+  bool is_fresh = buffer->middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH;
+  if (is_fresh)
+  {
+    uint32_t old = buffer->middle.exchange(buffer->front, std::memory_order_acq_rel);
+    buffer->front = old & TRIPLE_BUFFER_INDEX;
+    buffer->picked_up++;
+  }
+
+  if (fresh != NULL)
+  {
+    *fresh = is_fresh;
+  }
+  return &buffer->slots[buffer->front].value;
+}
+
+#endif  // TRIPLE_BUFFER_HPP
@@ -0,0 +1,377 @@
+#ifndef VIRTUAL_KELO_ETHERCAT_HPP
+#define VIRTUAL_KELO_ETHERCAT_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <robif2b/functions/ethercat.h>
+#include <robif2b/functions/kelo_drive.h>
+
+#include "cycle_scheduler.hpp"
+
+#define VIRTUAL_KELO_MAX_DRIVES 8
+#define VIRTUAL_KELO_PRODUCT_CODE 0x02001001  // KELOD105
+#define VIRTUAL_KELO_MAX_STEP 0.0005          // s, longest integration step
+#define VIRTUAL_KELO_MAX_GAP 0.01             // s, longer gaps between updates are not simulated
+
+// command bits of the drives, as in the Kelo drive API
+#define VIRTUAL_KELO_COM1_ENABLE1 0x1
+#define VIRTUAL_KELO_COM1_ENABLE2 0x2
+#define VIRTUAL_KELO_COM1_MODE_MASK (0x3 << 2)
+#define VIRTUAL_KELO_COM1_MODE_VELOCITY (0x2 << 2)
+
+/**
+ * Platform of Kelo drives served by the virtual fieldbus.
+ *
+ * The drives are castor wheels at the pivot positions. Each one has two wheels
+ * at +-half_wheel_distance from its centre, castor_offset behind the pivot.
+ * Wheel 1 is on the right of the drive and turns backwards when the drive
+ * moves forward, as on the KELO drives.
+ */
+struct VirtualKeloPlatform
+{
+  int num_drives;
+  double pivot_positions[VIRTUAL_KELO_MAX_DRIVES * 2];  // [m] x, y in the platform frame
+  double pivot_offsets[VIRTUAL_KELO_MAX_DRIVES];        // [rad] added to the pivot encoders
+  double wheel_radius;                                  // [m]
+  double castor_offset;                                 // [m]
+  double half_wheel_distance;                           // [m]
+  double torque_constant;                               // [Nm/A] of the wheel motors
+  double velocity_gain;  // [Nm s/rad] of the wheel velocity controllers in velocity mode
+
+  double mass;             // [kg]
+  double inertia;          // [kg m^2] about the vertical axis
+  double linear_damping;   // [Ns/m]
+  double angular_damping;  // [Nms/rad]
+
+  int64_t exchange_ns;  // busy time of an exchange, the frame round trip on the wire
+};
+
+/**
+ * Stand-in for robif2b_ethercat with Kelo drives as slaves, see
+ * ethercat_backend.hpp.
+ *
+ * An update reads the setpoints of the command PDOs, currents or wheel
+ * velocities depending on the mode of the drive, integrates the
+ * platform over the time since the previous update and writes the
+ * measurement PDOs. The platform is a rigid body on castor wheels that do not
+ * slip: the wheel velocities and pivot rates follow from its twist, and the
+ * wheel torques act on it through the transpose of that mapping.
+ */
+struct VirtualKeloEthercat
+{
+  VirtualKeloPlatform platform;
+  struct robif2b_ethercat *ecat;
+
+  bool started;
+  int64_t start_ns;
+  int64_t last_update_ns;
+  long updates;
+
+  double pose[3];   // [m, m, rad] in the start frame
+  double twist[3];  // [m/s, m/s, rad/s] in the platform frame
+  double pivot_angles[VIRTUAL_KELO_MAX_DRIVES];
+  double pivot_rates[VIRTUAL_KELO_MAX_DRIVES];
+  double wheel_angles[VIRTUAL_KELO_MAX_DRIVES * 2];
+  double wheel_rates[VIRTUAL_KELO_MAX_DRIVES * 2];
+  double wheel_torques[VIRTUAL_KELO_MAX_DRIVES * 2];  // [Nm] last commanded
+};
+
+/**
+ * Fills in the geometry of the platform, the dynamics default to a Robile
+ * base carrying two arms.
+ *
+ * @param pivot_positions x, y of each pivot [m]
+ * @param pivot_offsets offsets of the pivot encoders [rad], as given to the
+ *                      robif2b encoder
+ */
+inline void initialize_virtual_kelo_platform(VirtualKeloPlatform *platform, int num_drives,
+                                             const double *pivot_positions,
+                                             const double *pivot_offsets, double wheel_radius,
+                                             double castor_offset, double half_wheel_distance)
+{
+  if (num_drives > VIRTUAL_KELO_MAX_DRIVES)
+  {
+    printf("At most %d virtual Kelo drives are supported\n", VIRTUAL_KELO_MAX_DRIVES);
+    num_drives = VIRTUAL_KELO_MAX_DRIVES;
+  }
+
+  platform->num_drives = num_drives;
+  for (int i = 0; i < num_drives; i++)
+  {
+    platform->pivot_positions[i * 2 + 0] = pivot_positions[i * 2 + 0];
+    platform->pivot_positions[i * 2 + 1] = pivot_positions[i * 2 + 1];
+    platform->pivot_offsets[i] = pivot_offsets[i];
+  }
+  platform->wheel_radius = wheel_radius;
+  platform->castor_offset = castor_offset;
+  platform->half_wheel_distance = half_wheel_distance;
+  platform->torque_constant = 0.29;
+  platform->velocity_gain = 2.0;
+
+  platform->mass = 120.0;
+  platform->inertia = 8.0;
+  platform->linear_damping = 40.0;
+  platform->angular_damping = 10.0;
+
+  platform->exchange_ns = 0;
+}
+
+/**
+ * Velocities of the wheels of a drive per unit platform twist.
+ *
+ * @param jacobian rows of wheel 1 and 2, columns vx, vy, wz [1/m, 1/m, 1]
+ */
+inline void virtual_kelo_drive_jacobian(const VirtualKeloPlatform *platform, int drive,
+                                        double pivot_angle, double jacobian[2][3])
+{
+  double px = platform->pivot_positions[drive * 2 + 0];
+  double py = platform->pivot_positions[drive * 2 + 1];
+  double c = cos(pivot_angle);
+  double s = sin(pivot_angle);
+
+  // velocity of the pivot along (forward) and across (lateral) the drive
+  double forward[3] = {c, s, -py * c + px * s};
+  double lateral[3] = {-s, c, py * s + px * c};
+
+  // the wheels do not slip sideways, so the lateral velocity turns the drive
+  double steer = platform->half_wheel_distance / platform->castor_offset;
+  for (int k = 0; k < 3; k++)
+  {
+    jacobian[0][k] = -(forward[k] + steer * lateral[k]) / platform->wheel_radius;
+    jacobian[1][k] = (forward[k] - steer * lateral[k]) / platform->wheel_radius;
+  }
+}
+
+inline void virtual_kelo_ethercat_step(VirtualKeloEthercat *v, double dt)
+{
+  const VirtualKeloPlatform *p = &v->platform;
+
+  // wheel torques as generalized forces on the platform
+  double force[3] = {-p->linear_damping * v->twist[0], -p->linear_damping * v->twist[1],
+                     -p->angular_damping * v->twist[2]};
+  double jacobians[VIRTUAL_KELO_MAX_DRIVES][2][3];
+  for (int i = 0; i < p->num_drives; i++)
+  {
+    virtual_kelo_drive_jacobian(p, i, v->pivot_angles[i], jacobians[i]);
+    for (int k = 0; k < 3; k++)
+    {
+      force[k] += jacobians[i][0][k] * v->wheel_torques[i * 2 + 0] +
+                  jacobians[i][1][k] * v->wheel_torques[i * 2 + 1];
+    }
+  }
+
+  // semi-implicit Euler
+  v->twist[0] += force[0] / p->mass * dt;
+  v->twist[1] += force[1] / p->mass * dt;
+  v->twist[2] += force[2] / p->inertia * dt;
+
+  double c = cos(v->pose[2]);
+  double s = sin(v->pose[2]);
+  v->pose[0] += (c * v->twist[0] - s * v->twist[1]) * dt;
+  v->pose[1] += (s * v->twist[0] + c * v->twist[1]) * dt;
+  v->pose[2] += v->twist[2] * dt;
+
+  for (int i = 0; i < p->num_drives; i++)
+  {
+    for (int w = 0; w < 2; w++)
+    {
+      double rate = 0.0;
+      for (int k = 0; k < 3; k++)
+      {
+        rate += jacobians[i][w][k] * v->twist[k];
+      }
+      v->wheel_rates[i * 2 + w] = rate;
+      v->wheel_angles[i * 2 + w] += rate * dt;
+    }
+
+    // the drive turns with the wheel velocity difference, the pivot relative
+    // to the platform
+    double drive_rate = -(v->wheel_rates[i * 2 + 0] + v->wheel_rates[i * 2 + 1]) *
+                        p->wheel_radius / (2 * p->half_wheel_distance);
+    v->pivot_rates[i] = drive_rate - v->twist[2];
+    v->pivot_angles[i] = remainder(v->pivot_angles[i] + v->pivot_rates[i] * dt, 2 * M_PI);
+  }
+}
+
+inline double virtual_kelo_wheel_torque(const VirtualKeloPlatform *platform, uint32_t command,
+                                        uint32_t enable, double setpoint, double wheel_rate,
+                                        double limit_n, double limit_p)
+{
+  if (!(command & enable))
+  {
+    return 0.0;
+  }
+
+  double current = setpoint;
+  if ((command & VIRTUAL_KELO_COM1_MODE_MASK) == VIRTUAL_KELO_COM1_MODE_VELOCITY)
+  {
+    current = platform->velocity_gain * (setpoint - wheel_rate) / platform->torque_constant;
+  }
+
+  return fmin(fmax(current, limit_n), limit_p) * platform->torque_constant;
+}
+
+inline void virtual_kelo_ethercat_read_commands(VirtualKeloEthercat *v)
+{
+  for (int i = 0; i < v->platform.num_drives; i++)
+  {
+    const struct robif2b_kelo_drive_api_cmd_pdo *cmd =
+        (const struct robif2b_kelo_drive_api_cmd_pdo *)v->ecat->output[i];
+
+    v->wheel_torques[i * 2 + 0] = virtual_kelo_wheel_torque(
+        &v->platform, cmd->command1, VIRTUAL_KELO_COM1_ENABLE1, cmd->setpoint1,
+        v->wheel_rates[i * 2 + 0], cmd->limit1_n, cmd->limit1_p);
+    v->wheel_torques[i * 2 + 1] = virtual_kelo_wheel_torque(
+        &v->platform, cmd->command1, VIRTUAL_KELO_COM1_ENABLE2, cmd->setpoint2,
+        v->wheel_rates[i * 2 + 1], cmd->limit2_n, cmd->limit2_p);
+  }
+}
+
+inline void virtual_kelo_ethercat_write_measurements(VirtualKeloEthercat *v, int64_t now_ns)
+{
+  uint64_t timestamp_us = (uint64_t)((now_ns - v->start_ns) / 1000);
+
+  for (int i = 0; i < v->platform.num_drives; i++)
+  {
+    struct robif2b_kelo_drive_api_msr_pdo *msr =
+        (struct robif2b_kelo_drive_api_msr_pdo *)v->ecat->input[i];
+
+    memset(msr, 0, sizeof(*msr));
+    msr->sensor_ts = timestamp_us;
+    msr->setpoint_ts = timestamp_us;
+    msr->imu_ts = timestamp_us;
+
+    msr->encoder_1 = (float)v->wheel_angles[i * 2 + 0];
+    msr->velocity_1 = (float)v->wheel_rates[i * 2 + 0];
+    msr->current_1_q = (float)(v->wheel_torques[i * 2 + 0] / v->platform.torque_constant);
+    msr->encoder_2 = (float)v->wheel_angles[i * 2 + 1];
+    msr->velocity_2 = (float)v->wheel_rates[i * 2 + 1];
+    msr->current_2_q = (float)(v->wheel_torques[i * 2 + 1] / v->platform.torque_constant);
+
+    double encoder_pivot = fmod(v->pivot_angles[i] + v->platform.pivot_offsets[i], 2 * M_PI);
+    msr->encoder_pivot = (float)(encoder_pivot < 0.0 ? encoder_pivot + 2 * M_PI : encoder_pivot);
+    msr->velocity_pivot = (float)v->pivot_rates[i];
+
+    msr->gyro_z = (float)v->twist[2];
+    msr->accel_z = 9.81f;
+    msr->voltage_bus = 48.0f;
+    msr->temperature_1 = 30.0f;
+    msr->temperature_2 = 30.0f;
+  }
+}
+
+/**
+ * Checks the requested slaves against the virtual drives, like
+ * robif2b_ethercat_configure does against the slaves on the segment.
+ */
+inline void virtual_kelo_ethercat_configure(VirtualKeloEthercat *v, struct robif2b_ethercat *ecat)
+{
+  v->ecat = ecat;
+  v->started = false;
+  *ecat->error_code = 0;
+
+  int num_slaves = *ecat->num_exposed_slaves;
+  if (num_slaves != v->platform.num_drives)
+  {
+    printf("Virtual EtherCAT: %d slaves requested, %d drives simulated\n", num_slaves,
+           v->platform.num_drives);
+    *ecat->error_code = -1;
+    return;
+  }
+
+  for (int i = 0; i < num_slaves; i++)
+  {
+    if (ecat->product_code[i] != VIRTUAL_KELO_PRODUCT_CODE ||
+        ecat->input_size[i] != sizeof(struct robif2b_kelo_drive_api_msr_pdo) ||
+        ecat->output_size[i] != sizeof(struct robif2b_kelo_drive_api_cmd_pdo))
+    {
+      printf("Virtual EtherCAT: slave %d (%s) is not a Kelo drive\n", ecat->slave_idx[i],
+             ecat->name[i]);
+      *ecat->error_code = -1;
+      return;
+    }
+    ecat->is_connected[i] = true;
+  }
+
+  *ecat->num_initial_slaves = num_slaves;
+  *ecat->num_current_slaves = num_slaves;
+
+  memset(v->pose, 0, sizeof(v->pose));
+  memset(v->twist, 0, sizeof(v->twist));
+  memset(v->pivot_angles, 0, sizeof(v->pivot_angles));
+  memset(v->pivot_rates, 0, sizeof(v->pivot_rates));
+  memset(v->wheel_angles, 0, sizeof(v->wheel_angles));
+  memset(v->wheel_rates, 0, sizeof(v->wheel_rates));
+  memset(v->wheel_torques, 0, sizeof(v->wheel_torques));
+
+  printf("Virtual EtherCAT: %d Kelo drives on %s, exchange %.1f us\n", num_slaves,
+         ecat->ethernet_if, v->platform.exchange_ns / 1e3);
+}
+
+inline void virtual_kelo_ethercat_start(VirtualKeloEthercat *v)
+{
+  v->started = true;
+  v->start_ns = cycle_scheduler_now_ns();
+  v->last_update_ns = v->start_ns;
+  v->updates = 0;
+  virtual_kelo_ethercat_write_measurements(v, v->start_ns);
+}
+
+/**
+ * Integrates the platform under the last commanded wheel torques up to
+ * until_ns, longer gaps than VIRTUAL_KELO_MAX_GAP are not simulated.
+ */
+inline void virtual_kelo_ethercat_integrate(VirtualKeloEthercat *v, int64_t until_ns)
+{
+  double remaining = (double)(until_ns - v->last_update_ns) / NS_PER_SECOND;
+  remaining = fmin(remaining, VIRTUAL_KELO_MAX_GAP);
+  v->last_update_ns = until_ns;
+  while (remaining > 0.0)
+  {
+    double step = fmin(remaining, VIRTUAL_KELO_MAX_STEP);
+    remaining -= step;
+    virtual_kelo_ethercat_step(v, step);
+  }
+}
+
+/**
+ * Exchanges the process data: integrates the platform up to now under the
+ * last commanded torques, then picks up the current commands.
+ */
+inline void virtual_kelo_ethercat_update(VirtualKeloEthercat *v)
+{
+  if (!v->started)
+  {
+    return;
+  }
+
+  int64_t start_ns = cycle_scheduler_now_ns();
+  virtual_kelo_ethercat_integrate(v, start_ns);
+
+  virtual_kelo_ethercat_read_commands(v);
+  virtual_kelo_ethercat_write_measurements(v, start_ns);
+  v->updates++;
+
+  // the frame round trip on the wire
+  while (cycle_scheduler_now_ns() - start_ns < v->platform.exchange_ns)
+  {
+  }
+}
+
+inline void virtual_kelo_ethercat_stop(VirtualKeloEthercat *v)
+{
+  memset(v->wheel_torques, 0, sizeof(v->wheel_torques));
+  v->started = false;
+}
+
+inline void virtual_kelo_ethercat_shutdown(VirtualKeloEthercat *v)
+{
+  printf("Virtual EtherCAT: %ld updates, platform at x: %.3f m, y: %.3f m, yaw: %.3f rad\n",
+         v->updates, v->pose[0], v->pose[1], v->pose[2]);
+  v->ecat = NULL;
+}
+
+#endif  // VIRTUAL_KELO_ETHERCAT_HPP
@@ -0,0 +1,287 @@
+import json
+
+# fallback costs [us] of the primitives of the generated control loop, to be
+# replaced by the output of gen/cycle_budget_calibration on the target
+# computer. The robot I/O cannot be calibrated offline, its costs come from
+# the stage timing of a run on the robot (stage_timing.txt).
+DEFAULT_PRIMITIVE_COSTS = {
+    "computePosition": 15.0,
+    "computeQuaternion": 15.0,
+    "computeForwardVelocityKinematics": 20.0,
+    "computeForce": 15.0,
+    "computeDistance": 25.0,
+    "computeDistance1D": 25.0,
+    "pid_controller": 0.5,
+    "impedance_controller": 0.5,
+    "embed_mapping_vector": 0.1,
+    "embed_mapping_vector_info": 20.0,
+    "transform_alpha": 15.0,
+    "transform_wrench": 10.0,
+    "achd_solver": 60.0,
+    "achd_solver_fext": 40.0,
+    "base_fd_solver": 10.0,
+    "acquire_Manipulator": 120.0,
+    "acquire_MobileBase": 60.0,
+    "command_Manipulator": 40.0,
+    "command_MobileBase": 10.0,
+    "update_fk_cache": 25.0,
+    "fk_cache_lookup": 1.0,
+    "update_achd_sweep": 20.0,
+    "achd_sweep_solve": 5.0,
+    "achd_sweep_add_wrench": 0.5,
+    "achd_sweep_wrench_torques": 2.0,
+    "achd_sweep_solve_with_wrenches": 6.8,
+    "solver_worker_dispatch": 1.0,
+}
+
+# statistic of the calibrated costs the estimate is based on
+COST_STATISTIC = "p99_us"
+
+
+def load_primitive_costs(file_path: str = None) -> dict:
+    """
+    Returns the costs [us] of the primitives, the calibrated ones from the
+    output of gen/cycle_budget_calibration if given, else the fallback ones.
+    """
+    costs = dict(DEFAULT_PRIMITIVE_COSTS)
+
+    if file_path is not None:
+        with open(file_path, "r") as f:
+            calibrated = json.load(f)
+        for primitive, stats in calibrated.items():
+            costs[primitive] = stats[COST_STATISTIC] if isinstance(stats, dict) else stats
+
+    return costs
+
+
+def _cost(costs: dict, primitive: str) -> float:
+    if primitive not in costs:
+        raise ValueError(f"No cost known for primitive: {primitive}")
+    return costs[primitive]
+
+
+def _fk_cost(costs: dict, entry: dict, primitive: str) -> float:
+    """
+    Cost of a pose-based primitive, a lookup in the FK cache if the entry
+    reads its poses from it.
+    """
+    return _cost(costs, "fk_cache_lookup" if entry.get("fk_cached") else primitive)
+
+
+def _solver_cost(costs: dict, solver: dict) -> float:
+    if solver.get("sweep"):
+        return _swept_solver_cost(costs, solver)
+
+    match solver["name"]:
+        case "achd_solver":
+            return _fk_cost(costs, solver, "transform_alpha") + _cost(costs, "achd_solver")
+        case "achd_solver_fext":
+            return len(solver["ext_wrench"]) * _fk_cost(costs, solver, "transform_wrench") + _cost(
+                costs, "achd_solver_fext"
+            )
+        case "base_fd_solver":
+            transforms = [f for f in solver["platform_force"] if f["transform"]]
+            return len(transforms) * _cost(costs, "transform_wrench") + _cost(
+                costs, "base_fd_solver"
+            )
+        case _:
+            return _cost(costs, solver["name"])
+
+
+def _swept_solver_cost(costs: dict, solver: dict) -> float:
+    """
+    Cost of an ACHD solver whose arm is swept: the dynamics are computed by
+    the sweep, the solver only solves for its constraints or wrenches. A
+    combined achd_solver solves for both.
+    """
+    wrenches = len(solver["ext_wrench"]) * _cost(costs, "achd_sweep_add_wrench")
+    if solver["name"] == "achd_solver" and solver.get("combined"):
+        return wrenches + _cost(costs, "achd_sweep_solve_with_wrenches")
+    if solver["name"] == "achd_solver":
+        return _cost(costs, "achd_sweep_solve")
+    return wrenches + _cost(costs, "achd_sweep_wrench_torques")
+
+
+def _fk_cache_update_cost(costs: dict, d: dict, loop: dict) -> float:
+    """
+    Cost of updating the FK cache, the chains of the swept arms are walked by
+    their sweeps instead.
+    """
+    arms = sum(1 for robot in d["robots"].values() if robot["type"] == "Manipulator")
+    sweeps = loop.get("achd_sweeps", [])
+    unswept = max(arms - len(sweeps), 0) / arms if arms else 1.0
+    return unswept * _cost(costs, "update_fk_cache") + len(sweeps) * _cost(
+        costs, "update_achd_sweep"
+    )
+
+
+def _compute_variable_cost(costs: dict, v: dict) -> float:
+    return _fk_cost(costs, v, v["measure_variable"])
+
+
+def _embed_map_cost(costs: dict, m: dict) -> float:
+    if m["vector"]:
+        return _cost(costs, "embed_mapping_vector")
+    return _fk_cost(costs, m, "embed_mapping_vector_info")
+
+
+def _partition_cost(costs: dict, d: dict, partition: dict) -> float:
+    return (
+        sum(_compute_variable_cost(costs, d["compute_variables"][v])
+            for v in partition["compute_variables"])
+        + sum(_cost(costs, d["controllers"][c]["name"]) for c in partition["controllers"])
+        + sum(_embed_map_cost(costs, m) for s in partition["embed_maps"]
+              for m in d["embed_maps"][s])
+        + sum(_solver_cost(costs, d["solvers"][s]) for s in partition["solvers"])
+    )
+
+
+def _partition_stages(costs: dict, d: dict, partition: dict) -> dict:
+    return {
+        "compute_variables": sum(
+            _compute_variable_cost(costs, d["compute_variables"][v])
+            for v in partition["compute_variables"]
+        ),
+        "controllers": sum(
+            _cost(costs, d["controllers"][c]["name"]) for c in partition["controllers"]
+        ),
+        "embed_maps": sum(
+            _embed_map_cost(costs, m) for s in partition["embed_maps"] for m in d["embed_maps"][s]
+        ),
+        "solvers": sum(_solver_cost(costs, d["solvers"][s]) for s in partition["solvers"]),
+    }
+
+
+def estimate_cycle_budget(data: dict, costs: dict) -> dict:
+    """
+    Predict the worst-case compute time of one cycle of the generated loop,
+    broken down into its stages.
+
+    Every entry is counted in every cycle, including the rate-divided ones,
+    since all rate groups are due in the first cycle and whenever their
+    divisors coincide.
+
+    The robots are acquired concurrently, so acquisition costs the slowest
+    one. A pipelined loop also sends the commands on the io workers, which
+    overlap with the compute of the cycle; the control thread only waits for
+    the part of the robot I/O that outlasts the compute. With asynchronous
+    actuation the commands are sent during the slack of the cycle; the next
+    cycle only waits for the part of the slowest command that outlasts it.
+    With robot threads, the stages only count the shared entries computed on
+    the control thread, and the robot threads cost the slowest robot's own
+    entries and command. A split process only counts its own robots and
+    entries. With the FK cache, the link poses are computed once per cycle
+    and every pose-based primitive costs a lookup; with the ACHD sweep, the
+    dynamics of the arms are computed along with them and the ACHD solvers
+    only solve for their constraints and wrenches. With parallel solvers, the
+    solver stage costs the slower of the solver worker and the control thread
+    plus the fork and join.
+    """
+    d = data["d"]
+    loop = data["loop"]
+    robots = d["robots"].values()
+    stages = {}
+
+    stages["get_robot_data"] = max(
+        (_cost(costs, f"acquire_{robot['type']}") for robot in robots), default=0.0
+    )
+    if loop.get("fk_cache", False):
+        stages["update_fk_cache"] = _fk_cache_update_cost(costs, d, loop)
+    stages["compute_variables"] = sum(
+        _compute_variable_cost(costs, v) for v in d["compute_variables"].values()
+    )
+    stages["controllers"] = sum(
+        _cost(costs, c["name"]) for c in d["controllers"].values()
+    )
+    stages["embed_maps"] = sum(
+        _embed_map_cost(costs, m) for maps in d["embed_maps"].values() for m in maps
+    )
+    stages["solvers"] = sum(_solver_cost(costs, s) for s in d["solvers"].values())
+    worker = loop.get("solver_worker")
+    if worker is not None:
+        stages["solvers"] = max(
+            sum(_solver_cost(costs, d["solvers"][s]) for s in worker["solvers"]),
+            sum(_solver_cost(costs, d["solvers"][s]) for s in worker["control_solvers"]),
+        ) + _cost(costs, "solver_worker_dispatch")
+    stages["set_robot_command_torques"] = sum(
+        _cost(costs, f"command_{robot['type']}") for robot in robots
+    )
+
+    process = loop.get("process")
+    if process is not None:
+        own = [d["robots"][robot] for robot in process["robots"]]
+        stages.update(_partition_stages(costs, d, process))
+        stages["get_robot_data"] = max(
+            (_cost(costs, f"acquire_{robot['type']}") for robot in own), default=0.0
+        )
+        stages["set_robot_command_torques"] = sum(
+            _cost(costs, f"command_{robot['type']}") for robot in own
+        )
+
+    if loop.get("pipelined", False):
+        io = max(
+            (
+                _cost(costs, f"acquire_{robot['type']}")
+                + _cost(costs, f"command_{robot['type']}")
+                for robot in robots
+            ),
+            default=0.0,
+        )
+        compute = sum(
+            cost
+            for stage, cost in stages.items()
+            if stage not in ("get_robot_data", "set_robot_command_torques")
+        )
+        stages["get_robot_data"] = max(io - compute, 0.0)
+        stages["set_robot_command_torques"] = 0.0
+
+    if loop.get("robot_threads", False):
+        stages.update(_partition_stages(costs, d, loop["shared_partition"]))
+        stages["set_robot_command_torques"] = 0.0
+        stages["robot_threads"] = max(
+            (
+                _partition_cost(costs, d, p)
+                + _cost(costs, f"command_{d['robots'][p['robot']]['type']}")
+                for p in loop["robot_partitions"]
+            ),
+            default=0.0,
+        )
+
+    period = 1e6 / loop["frequency"]
+
+    if loop.get("async_actuation", False):
+        command = max(
+            (_cost(costs, f"command_{robot['type']}") for robot in robots), default=0.0
+        )
+        stages["set_robot_command_torques"] = 0.0
+        slack = period - sum(stages.values())
+        stages["get_robot_data"] += max(command - slack, 0.0)
+
+    budget = period * loop["budget_fraction"]
+
+    return {
+        "period_us": period,
+        "budget_us": budget,
+        "predicted_us": sum(stages.values()),
+        "stages_us": stages,
+    }
+
+
+def print_cycle_budget(estimate: dict, calibrated: bool):
+    print(f"Cycle budget estimate ({'calibrated' if calibrated else 'fallback'} costs):")
+    for stage, cost in estimate["stages_us"].items():
+        print(f"  {stage:<28} {cost:9.1f} us")
+    print(f"  {'total':<28} {estimate['predicted_us']:9.1f} us")
+    print(
+        f"  {'budget':<28} {estimate['budget_us']:9.1f} us"
+        f" ({estimate['period_us']:.1f} us period)"
+    )
+
+
+def check_cycle_budget(estimate: dict):
+    if estimate["predicted_us"] > estimate["budget_us"]:
+        raise ValueError(
+            f"Predicted cycle time of {estimate['predicted_us']:.1f} us exceeds the "
+            f"budget of {estimate['budget_us']:.1f} us at "
+            f"{1e6 / estimate['period_us']:.1f} Hz"
+        )
@@ -0,0 +1,712 @@
+import json
+
+DEFAULT_LOOP_CONFIG = {
+    "frequency": 1000.0,
+    "rate_divisors": {},
+    "overrun_policy": None,
+    "sample_sources": {},
+    "budget_fraction": 1.0,
+    "pipelined": False,
+    "async_actuation": False,
+    "robot_threads": False,
+    "robot_cpus": {},
+    "control_thread_robot": None,
+    "split_processes": False,
+    "process_link": "/motion_spec_link",
+    "stale_cycles": 10,
+    "process_rt": {},
+    "fk_cache": False,
+    "achd_sweep": False,
+    "parallel_solvers": False,
+    "solver_worker_cpu": -1,
+    "combined_achd": False,
+}
+
+DEFAULT_OVERRUN_POLICY = {
+    "levels": [],
+    "recover_cycles": 100,
+    "guard_fraction": 0.8,
+}
+
+# largest error of a pid controller whose delay is compensated, see
+# gen/delay_compensation.hpp
+DELAY_COMPENSATION_MAX_SIZE = 6
+
+# maximum number of degradation levels supported by OverrunPolicy in
+# gen/overrun_policy.hpp
+MAX_DEGRADATION_LEVELS = 8
+
+# compute variables whose measurement only needs link poses, read from the
+# per-cycle forward-kinematics cache (gen/fk_cache.hpp) if enabled
+FK_CACHED_MEASUREMENTS = ["computePosition", "computeQuaternion", "computeDistance",
+                          "computeDistance1D"]
+
+# solvers that transform their inputs between link frames
+FK_CACHED_SOLVERS = ["achd_solver", "achd_solver_fext"]
+
+# sizes the ACHD sweep can be specialised for at generation time,
+# ACHD_SWEEP_MAX_JOINTS and ACHD_SWEEP_MAX_CONSTRAINTS in gen/achd_sweep.hpp
+ACHD_SWEEP_MAX_JOINTS = 7
+ACHD_SWEEP_MAX_CONSTRAINTS = 6
+
+# sections of the IR whose entries can run at a fraction of the loop rate
+RATE_DIVIDED_SECTIONS = ["controllers", "compute_variables", "solvers"]
+
+
+def _rate_divided_entries(d: dict) -> dict:
+    entries = {}
+    for section in RATE_DIVIDED_SECTIONS:
+        entries.update(d[section])
+    for monitors in d["monitors"].values():
+        entries.update(monitors)
+    return entries
+
+
+def translate_loop_config(config: dict, data: dict) -> dict:
+    """
+    Validate the control loop configuration and annotate the controllers,
+    compute variables, monitors and solvers of the IR with their rate divisor.
+
+    An entry with a rate divisor N only runs every N-th cycle and holds its
+    outputs in between. Entries without a divisor (or with 1) run every cycle
+    and are left untouched, so `rate_divisor` is only present for slow ones.
+
+    Returns the `loop` section of the IR, including the distinct rate groups
+    the generated loop has to schedule, the overrun policy, if any, and the
+    actuation delay in cycles.
+    """
+    loop = dict(DEFAULT_LOOP_CONFIG)
+
+    unknown = set(config) - set(loop)
+    if unknown:
+        raise ValueError(f"Unknown loop configuration keys: {sorted(unknown)}")
+
+    loop.update(config)
+
+    if loop["frequency"] <= 0:
+        raise ValueError("Control loop frequency must be positive")
+
+    if not 0 < loop["budget_fraction"] <= 1:
+        raise ValueError("Budget fraction of the period must be in (0, 1]")
+
+    if not isinstance(loop["pipelined"], bool):
+        raise ValueError("pipelined must be true or false")
+
+    if not isinstance(loop["async_actuation"], bool):
+        raise ValueError("async_actuation must be true or false")
+
+    if loop["pipelined"] and loop["async_actuation"]:
+        raise ValueError("A pipelined loop already sends its commands asynchronously")
+
+    if not isinstance(loop["robot_threads"], bool):
+        raise ValueError("robot_threads must be true or false")
+
+    if loop["robot_threads"] and (loop["pipelined"] or loop["async_actuation"]):
+        raise ValueError("Robot threads command their robots themselves, they can not be "
+                         "combined with a pipelined loop or asynchronous actuation")
+
+    if not isinstance(loop["split_processes"], bool):
+        raise ValueError("split_processes must be true or false")
+
+    if loop["split_processes"] and (
+        loop["pipelined"] or loop["async_actuation"] or loop["robot_threads"]
+    ):
+        raise ValueError("Split processes can not be combined with a pipelined loop, "
+                         "asynchronous actuation or robot threads")
+
+    if not loop["split_processes"] and loop["process_rt"]:
+        raise ValueError("process_rt needs split_processes")
+
+    if not isinstance(loop["stale_cycles"], int) or loop["stale_cycles"] < 1:
+        raise ValueError("stale_cycles must be a positive integer")
+
+    if not isinstance(loop["fk_cache"], bool):
+        raise ValueError("fk_cache must be true or false")
+
+    if loop["fk_cache"] and loop["robot_threads"]:
+        raise ValueError("The FK cache is updated on the control thread, it can not be read "
+                         "by robot threads")
+
+    if not isinstance(loop["achd_sweep"], bool):
+        raise ValueError("achd_sweep must be true or false")
+
+    if loop["achd_sweep"] and not loop["fk_cache"]:
+        raise ValueError("achd_sweep writes the link poses of the FK cache, it needs fk_cache")
+
+    if not isinstance(loop["parallel_solvers"], bool):
+        raise ValueError("parallel_solvers must be true or false")
+
+    if loop["parallel_solvers"] and not loop["achd_sweep"]:
+        raise ValueError("parallel_solvers needs achd_sweep, the solvers of the arms only share "
+                         "no state when every arm is swept on its own")
+
+    if loop["parallel_solvers"] and loop["split_processes"]:
+        raise ValueError("parallel_solvers cannot be combined with split_processes")
+
+    if not isinstance(loop["solver_worker_cpu"], int) or loop["solver_worker_cpu"] < -1:
+        raise ValueError("solver_worker_cpu must be a cpu or -1 for the helper cpus")
+
+    if not isinstance(loop["combined_achd"], bool):
+        raise ValueError("combined_achd must be true or false")
+
+    if loop["combined_achd"] and not loop["achd_sweep"]:
+        raise ValueError("combined_achd solves on the sweep of the arm, it needs achd_sweep")
+
+    # a pipelined loop computes cycle k on the samples the io workers acquired
+    # at the start of cycle k-1, and its commands are only sent at the start of
+    # cycle k+1, two periods after their samples
+    loop["actuation_delay_cycles"] = 2 if loop["pipelined"] else 0
+
+    entries = _rate_divided_entries(data["d"])
+
+    rate_groups = set()
+    for id, divisor in loop["rate_divisors"].items():
+        if id not in entries:
+            raise ValueError(f"Rate divisor given for unknown entry: {id}")
+        if not isinstance(divisor, int) or divisor < 1:
+            raise ValueError(f"Rate divisor of {id} must be a positive integer")
+
+        if divisor == 1:
+            continue
+
+        entries[id]["rate_divisor"] = divisor
+        rate_groups.add(divisor)
+
+    loop["rate_groups"] = [{"divisor": divisor} for divisor in sorted(rate_groups)]
+
+    _tag_sample_sources(loop["sample_sources"], data)
+    _tag_delay_compensated(loop, data)
+    loop["odometry_source"] = _odometry_source(data)
+
+    if loop["robot_threads"]:
+        _partition_robot_threads(loop, data)
+    elif loop["robot_cpus"] or loop["control_thread_robot"] is not None:
+        raise ValueError("robot_cpus and control_thread_robot need robot_threads")
+
+    if loop["overrun_policy"] is not None:
+        loop["overrun_policy"] = _translate_overrun_policy(loop["overrun_policy"], data)
+
+    if loop["fk_cache"]:
+        _tag_fk_cached(loop, data)
+
+    if loop["combined_achd"]:
+        _combine_achd_solvers(loop, data)
+
+    if loop["parallel_solvers"]:
+        _partition_solvers(loop, data)
+
+    return loop
+
+
+def _tag_sample_sources(sample_sources: dict, data: dict):
+    """
+    Annotate the pid controllers with the robot their measurement is sampled
+    from. Such a controller integrates over the interval between the samples
+    of that robot instead of the period of the loop.
+    """
+    controllers = data["d"]["controllers"]
+    robots = data["d"]["robots"]
+
+    for id, robot in sample_sources.items():
+        if id not in controllers:
+            raise ValueError(f"Sample source given for unknown controller: {id}")
+        if "dt" not in controllers[id]:
+            raise ValueError(f"{id} does not integrate over time, it has no sample source")
+        if robot not in robots:
+            raise ValueError(f"Unknown sample source of {id}: {robot}")
+
+        controllers[id]["sample_source"] = robot
+
+
+def _odometry_source(data: dict):
+    """
+    The mobile base whose odometry get_robot_data integrates over the interval
+    between its samples, None without a base (the odometry then integrates
+    over the period of the loop). get_robot_data takes a single interval, so
+    a model with several bases can not be generated.
+    """
+    bases = [
+        robot for robot, robot_data in data["d"]["robots"].items()
+        if robot_data["type"] == "MobileBase"
+    ]
+    if len(bases) > 1:
+        raise ValueError(f"get_robot_data integrates the odometry of a single mobile base, "
+                         f"the model has {len(bases)}: {bases}")
+
+    return bases[0] if bases else None
+
+
+def _tag_delay_compensated(loop: dict, data: dict):
+    """
+    Annotate the pid controllers of a loop with an actuation delay: their
+    commands take effect `actuation_delay_cycles` after the samples they are
+    computed from, so they act on their error predicted over that delay
+    (gen/delay_compensation.hpp). `loop["delay_compensated"]` lists them.
+    """
+    loop["delay_compensated"] = []
+    if loop["actuation_delay_cycles"] == 0:
+        return
+
+    for id, controller in data["d"]["controllers"].items():
+        if controller["name"] != "pid_controller":
+            continue
+        size = controller.get("size") or 1
+        if not isinstance(size, int) or size > DELAY_COMPENSATION_MAX_SIZE:
+            raise ValueError(f"The error of {id} is too large for its delay compensation")
+
+        controller["delay_compensated"] = True
+        loop["delay_compensated"].append(id)
+
+
+def _tag_fk_cached(loop: dict, data: dict):
+    """
+    Annotate the entries that read their link poses from the FK cache instead
+    of computing them: the pose-based compute variables, the embed maps that
+    decompose a signal between two links and the transforms of the solvers.
+
+    The frames they name are interned: `loop["frame_ids"]` lists the frame
+    variables resolved to their ID in the cache once at initialization, and
+    `loop["link_ids"]` the links of the external wrenches resolved to their
+    index in the chain of the solver, so that the loop passes integers.
+
+    The constraints of an achd_solver that no other entry references keep
+    their initial value, `loop["constant_alphas"]` lists them: they are
+    transformed once at initialization if the root link of the solver is
+    rigid w.r.t. base_link.
+    """
+    d = data["d"]
+    frames = {}
+
+    compute_variables = list(d["compute_variables"].values())
+    compute_variables += list(data["initial_compute_variables"].values())
+    for v in compute_variables:
+        if v["measure_variable"] not in FK_CACHED_MEASUREMENTS:
+            continue
+        v["fk_cached"] = True
+
+        measured = v["measured"]
+        entities = measured["of"].get("entities") or [measured["of"]["entity"]]
+        for frame in entities + [measured["asb"], measured.get("wrt")]:
+            if frame is not None:
+                frames[frame] = True
+
+    for maps in d["embed_maps"].values():
+        for m in maps:
+            if m["vector"]:
+                continue
+            m["fk_cached"] = True
+
+            for key in ("from", "to", "asb"):
+                frames[m["vector_info"][key]] = True
+
+    link_ids = []
+    loop["achd_sweeps"] = []
+    loop["constant_alphas"] = []
+    for id, solver in d["solvers"].items():
+        if solver["name"] not in FK_CACHED_SOLVERS:
+            continue
+        solver["fk_cached"] = True
+
+        if loop["achd_sweep"]:
+            _tag_achd_sweep(loop, data, id, solver)
+            for ew in solver["ext_wrench"]:
+                frames[ew["link"]] = True
+                frames[ew["asb"]] = True
+            continue
+
+        frames[solver["root_link"]] = True
+        if solver["name"] == "achd_solver":
+            frames["base_link"] = True
+
+            solver["constant_alpha"] = _constant_variable(data, solver["alpha"], id)
+            if solver["constant_alpha"]:
+                loop["constant_alphas"].append(
+                    {"alpha": solver["alpha"], "nc": solver["nc"], "root_link": solver["root_link"]}
+                )
+
+        for ew in solver["ext_wrench"] if solver["name"] == "achd_solver_fext" else []:
+            frames[ew["asb"]] = True
+            ew["link_id"] = f"{id}_{ew['link']}_link_id"
+            link_ids.append(
+                {
+                    "name": ew["link_id"],
+                    "link": ew["link"],
+                    "root_link": solver["root_link"],
+                    "tip_link": solver["tip_link"],
+                }
+            )
+
+    unknown = [frame for frame in frames if frame not in data["variables"]]
+    if unknown:
+        raise ValueError(f"Frames of the FK cache are not variables of the spec: {unknown}")
+
+    loop["frame_ids"] = list(frames)
+    loop["link_ids"] = link_ids
+
+
+def _tag_achd_sweep(loop: dict, data: dict, id: str, solver: dict):
+    """
+    Annotate an ACHD solver with the sweep of its arm (gen/achd_sweep.hpp),
+    which computes the dynamics of the chain of the solver together with its
+    link poses once per cycle. The solver only solves for its constraints or
+    external wrenches from them, with the constraints and wrenches expressed
+    in base_link and the external wrenches at the links of the cache.
+
+    `loop["achd_sweeps"]` lists one sweep per arm, shared by the solvers on
+    the same chain. Where the spec fixes the number of joints (`nj`) and of
+    constraints (`nc`) within the sizes the sweep supports, the sweep and the
+    solve are instantiated for them (`nj` of the sweep, `fixed_size` of the
+    solver), else they are sized at run time. A spec with more constraints than
+    the solve supports is rejected, its systems would not fit on the stack.
+    """
+    variables = data["variables"]
+    root = variables[solver["root_link"]]["value"]
+    tip = variables[solver["tip_link"]]["value"]
+
+    robots = [
+        robot
+        for robot, robot_data in data["d"]["robots"].items()
+        if robot_data["type"] == "Manipulator" and robot_data["kinematic_chain_start"] == root
+    ]
+    if len(robots) != 1:
+        raise ValueError(f"No arm whose chain starts at {root} for the sweep of its solvers")
+
+    nj = _int_value(variables, solver["nj"])
+    if nj is not None and not 0 < nj <= ACHD_SWEEP_MAX_JOINTS:
+        nj = None
+
+    sweeps = loop["achd_sweeps"]
+    name = f"{robots[0]}_sweep"
+    sweep = next((s for s in sweeps if s["name"] == name), None)
+    if sweep is None:
+        sweep = {
+            "name": name,
+            "robot": robots[0],
+            "root_link": solver["root_link"],
+            "tip_link": solver["tip_link"],
+            "root_acceleration": None,
+            "nj": nj,
+        }
+        sweeps.append(sweep)
+    elif variables[sweep["tip_link"]]["value"] != tip:
+        raise ValueError(f"The solvers of {robots[0]} end at different links, no common sweep")
+    elif sweep["nj"] != nj:
+        raise ValueError(f"The solvers of {robots[0]} disagree on the number of joints")
+
+    solver["fixed_size"] = None
+    if solver["name"] == "achd_solver":
+        sweep["root_acceleration"] = solver["root_acceleration"]
+
+        nc = _int_value(variables, solver["nc"])
+        if nc is not None and nc > ACHD_SWEEP_MAX_CONSTRAINTS:
+            raise ValueError(f"{id} has {nc} constraints, the sweep solves at most "
+                             f"{ACHD_SWEEP_MAX_CONSTRAINTS}")
+        if nj is not None and nc is not None and nc > 0:
+            solver["fixed_size"] = {"nj": nj, "nc": nc}
+    solver["sweep"] = name
+
+
+def _combine_achd_solvers(loop: dict, data: dict):
+    """
+    Merge the achd_solver_fext solvers of each swept arm into its
+    achd_solver for `combined_achd`: the achd_solver takes over their
+    external wrenches and embed maps and outputs the sum of the constraint
+    and wrench torques, in one solve on the sweep. The merged solvers are
+    removed, and so are their outputs from the input torques of the arm.
+
+    Only merged where the sum is all that is read: the outputs of both are
+    inputs of the arm's commands and of no other entry, and both run at the
+    same rate and degrade level.
+    """
+    d = data["d"]
+    robots = d["robots"]
+
+    for sweep in loop["achd_sweeps"]:
+        solvers = [
+            id for id, solver in d["solvers"].items() if solver.get("sweep") == sweep["name"]
+        ]
+        achd = [id for id in solvers if d["solvers"][id]["name"] == "achd_solver"]
+        fext = [id for id in solvers if d["solvers"][id]["name"] == "achd_solver_fext"]
+        if len(achd) != 1 or not fext:
+            continue
+
+        solver = d["solvers"][achd[0]]
+        command_torques = robots[sweep["robot"]]["input_command_torques"]
+        for id in achd + fext:
+            output = d["solvers"][id]["output_torques"]
+            if output not in command_torques or any(
+                output in _references(entry)
+                for section in PARTITIONED_SECTIONS + ["embed_maps"]
+                for reader, entry in d[section].items()
+                if (section, reader) != ("solvers", id)
+            ):
+                raise ValueError(f"{output} is read by another entry than the commands of "
+                                 f"{sweep['robot']}, {id} cannot be combined")
+
+        for id in fext:
+            for key in ("rate_divisor", "degrade_level"):
+                if d["solvers"][id].get(key) != solver.get(key):
+                    raise ValueError(f"{id} and {achd[0]} differ in their {key}, they cannot be "
+                                     "combined")
+
+            merged = d["solvers"].pop(id)
+            solver["ext_wrench"] = solver["ext_wrench"] + merged["ext_wrench"]
+            command_torques.remove(merged["output_torques"])
+            if id in d["embed_maps"]:
+                d["embed_maps"][achd[0]] = d["embed_maps"].get(achd[0], []) + d[
+                    "embed_maps"
+                ].pop(id)
+
+        solver["combined"] = fext
+
+
+def _partition_solvers(loop: dict, data: dict):
+    """
+    Split the solvers between the control thread and a solver worker
+    (gen/solver_worker.hpp) for `parallel_solvers`: the worker runs the
+    solvers of the last swept arm, the control thread the others, in the
+    order of the IR.
+
+    The parts must not depend on each other's outputs, they run concurrently.
+    """
+    d = data["d"]
+    sweeps = loop["achd_sweeps"]
+    if len(sweeps) < 2:
+        raise ValueError("parallel_solvers needs the ACHD solvers of two arms")
+
+    arm = sweeps[-1]
+    worker = [id for id, solver in d["solvers"].items() if solver.get("sweep") == arm["name"]]
+    control = [id for id in d["solvers"] if id not in worker]
+
+    for part, other in ((worker, control), (control, worker)):
+        for id in part:
+            producers = {_producer_of(name, d["solvers"]) for name in _references(d["solvers"][id])}
+            dependencies = producers & set(other)
+            if dependencies:
+                raise ValueError(f"{id} depends on {sorted(dependencies)}, they cannot run in "
+                                 "parallel")
+
+    cpu = loop["solver_worker_cpu"]
+    if cpu >= 0 and data["rt"] is not None and data["rt"]["control_cpu"] == cpu:
+        raise ValueError("The solver worker must not share the control cpu")
+
+    loop["solver_worker"] = {
+        "name": arm["robot"],
+        "cpu": cpu,
+        "solvers": worker,
+        "control_solvers": control,
+    }
+
+
+def _constant_variable(data: dict, name: str, reader: str) -> bool:
+    """
+    Whether a variable keeps its initial value: it has one and no entry but
+    the solver reading it references it.
+    """
+    if data["variables"][name]["value"] is None:
+        return False
+
+    d = data["d"]
+    for section in PARTITIONED_SECTIONS + ["embed_maps"]:
+        for id, entry in d[section].items():
+            if (section, id) != ("solvers", reader) and name in _references(entry):
+                return False
+    return True
+
+
+def _int_value(variables: dict, name: str):
+    """
+    The value of an integer variable fixed by the spec, None if there is none.
+    """
+    variable = variables.get(name)
+    if variable is None or variable["dtype"] != "int" or not isinstance(variable["value"], int):
+        return None
+    return variable["value"]
+
+
+def _references(data) -> list:
+    if isinstance(data, str):
+        return [data]
+    if isinstance(data, dict):
+        return [r for value in data.values() for r in _references(value)]
+    if isinstance(data, list):
+        return [r for value in data for r in _references(value)]
+    return []
+
+
+def _producer_of(name: str, producers: list):
+    """
+    The entry a variable name belongs to, i.e. the entry with the longest id
+    the name starts with: `kl_achd_solver_fext_output_torques` belongs to
+    `kl_achd_solver_fext`, not to `kl_achd_solver`.
+    """
+    matches = [id for id in producers if name == id or name.startswith(id + "_")]
+    return max(matches, key=len, default=None)
+
+
+PARTITIONED_SECTIONS = ["compute_variables", "controllers", "solvers"]
+
+
+def robot_consumers(d: dict) -> dict:
+    """
+    The robots whose commands depend on each compute variable, controller and
+    solver of the IR.
+
+    The variables of the generated code are named after the entry producing
+    them, so an entry depends on the entries whose ids prefix the names it
+    references. The commands of a robot depend on the solvers producing its
+    input torques. A solver depends on the inputs of its embed maps as well.
+    """
+    producers = {id: section for section in PARTITIONED_SECTIONS for id in d[section]}
+
+    dependencies = {}
+    for id, section in producers.items():
+        references = _references(d[section][id])
+        if section == "solvers":
+            references += _references(d["embed_maps"].get(id, []))
+        dependencies[id] = {
+            producer
+            for producer in (_producer_of(name, producers) for name in references)
+            if producer is not None and producer != id
+        }
+
+    consumers = {id: set() for id in producers}
+    for robot, robot_data in d["robots"].items():
+        pending = [
+            producer
+            for producer in (
+                _producer_of(name, producers) for name in robot_data["input_command_torques"]
+            )
+            if producer is not None
+        ]
+        while pending:
+            id = pending.pop()
+            if robot in consumers[id]:
+                continue
+            consumers[id].add(robot)
+            pending.extend(dependencies[id])
+
+    return consumers
+
+
+def partition_entries(d: dict, consumers: dict, owner) -> dict:
+    """
+    The ids of the entries whose consumers satisfy `owner`, in IR order. The
+    embed maps of a solver go with the solver.
+    """
+    partition = {
+        section: [id for id in d[section] if owner(consumers[id])]
+        for section in PARTITIONED_SECTIONS
+    }
+    partition["embed_maps"] = [id for id in partition["solvers"] if id in d["embed_maps"]]
+    return partition
+
+
+def _partition_robot_threads(loop: dict, data: dict):
+    """
+    Split the compute variables, controllers and solvers of the IR into the
+    part of each robot thread and the shared part of the control thread.
+
+    An entry the commands of a single robot depend on runs on the thread of
+    that robot, an entry several (or no) robots depend on runs on the control
+    thread before the robot threads compute. The dependencies of a shared
+    entry are shared as well, so the robot threads only read what the control
+    thread computed before releasing them.
+    """
+    d = data["d"]
+    robots = list(d["robots"])
+
+    if not loop["robot_cpus"].keys() <= set(robots):
+        raise ValueError(f"robot_cpus given for unknown robots: "
+                         f"{sorted(loop['robot_cpus'].keys() - set(robots))}")
+
+    control_thread_robot = loop["control_thread_robot"]
+    if control_thread_robot is None:
+        control_thread_robot = robots[-1]
+    if control_thread_robot not in robots:
+        raise ValueError(f"Unknown control_thread_robot: {control_thread_robot}")
+    if control_thread_robot in loop["robot_cpus"]:
+        raise ValueError(f"{control_thread_robot} runs on the control thread, "
+                         f"it can not have a cpu of its own")
+
+    cpus = list(loop["robot_cpus"].values())
+    if any(not isinstance(cpu, int) or cpu < 0 for cpu in cpus):
+        raise ValueError("Robot cpus must be non-negative integers")
+    if len(set(cpus)) != len(cpus):
+        raise ValueError("Every robot thread needs a cpu of its own")
+    if data["rt"] is not None and data["rt"]["control_cpu"] in cpus:
+        raise ValueError("The control cpu must not be shared with the robot threads")
+
+    consumers = robot_consumers(d)
+
+    loop["robot_partitions"] = [
+        dict(
+            partition_entries(d, consumers, lambda c, robot=robot: c == {robot}),
+            robot=robot,
+            cpu=loop["robot_cpus"].get(robot, -1),
+            on_control_thread=robot == control_thread_robot,
+        )
+        for robot in robots
+    ]
+    loop["shared_partition"] = partition_entries(d, consumers, lambda c: len(c) != 1)
+
+
+def _translate_overrun_policy(config: dict, data: dict) -> dict:
+    """
+    Validate the overrun policy and annotate the degradable entries of the IR
+    with their degradation level.
+
+    `levels` lists the entries dropped at each level, starting with the least
+    important ones. Under overruns the loop degrades one level at a time and
+    skips the entries of all levels up to the current one, holding their
+    outputs, and recovers one level after `recover_cycles` cycles without
+    overrun. Independently of the level, degradable entries are skipped once
+    the cycle used more than `guard_fraction` of the period.
+
+    Solvers always run: they output the torques of the robots, which a
+    skipped solver would hold. So do the pid controllers: a resumed pid would
+    integrate and differentiate over one sample interval against an error
+    that is many cycles old.
+    """
+    policy = dict(DEFAULT_OVERRUN_POLICY)
+
+    unknown = set(config) - set(policy)
+    if unknown:
+        raise ValueError(f"Unknown overrun policy keys: {sorted(unknown)}")
+
+    policy.update(config)
+
+    if not 1 <= len(policy["levels"]) <= MAX_DEGRADATION_LEVELS:
+        raise ValueError(
+            f"Overrun policy needs between 1 and {MAX_DEGRADATION_LEVELS} levels"
+        )
+    if not isinstance(policy["recover_cycles"], int) or policy["recover_cycles"] < 1:
+        raise ValueError("Overrun policy recover_cycles must be a positive integer")
+    if policy["guard_fraction"] <= 0:
+        raise ValueError("Overrun policy guard_fraction must be positive")
+
+    entries = _rate_divided_entries(data["d"])
+
+    for level, ids in enumerate(policy["levels"], start=1):
+        for id in ids:
+            if id not in entries:
+                raise ValueError(f"Degradation level given for unknown entry: {id}")
+            if id in data["d"]["solvers"]:
+                raise ValueError(f"{id} is a solver and can not be degraded, the robots would "
+                                 "be commanded its held torques")
+            if data["d"]["controllers"].get(id, {}).get("name") == "pid_controller":
+                raise ValueError(f"{id} is a pid controller and can not be degraded, it would "
+                                 "resume against a stale error")
+            if "degrade_level" in entries[id]:
+                raise ValueError(f"{id} is assigned to more than one degradation level")
+
+            entries[id]["degrade_level"] = level
+
+    policy["num_levels"] = len(policy["levels"])
+
+    return policy
+
+
+def load_loop_config(file_path: str, data: dict) -> dict:
+    with open(file_path, "r") as f:
+        return translate_loop_config(json.load(f), data)
@@ -0,0 +1,109 @@
+import copy
+
+from motion_spec_gen.ir_gen.loop_config import robot_consumers, partition_entries
+from motion_spec_gen.ir_gen.rt_config import translate_rt_config
+
+# process controlling each robot type
+ROBOT_PROCESSES = {
+    "Manipulator": "arms",
+    "MobileBase": "base",
+}
+
+# ProcessLinkSide in gen/process_link.hpp
+PROCESS_LINK_SIDES = {
+    "arms": "PROCESS_LINK_ARMS",
+    "base": "PROCESS_LINK_BASE",
+}
+
+# arms supported by ArmsLinkState in gen/process_link.hpp
+MAX_LINK_ARMS = 2
+
+
+def split_processes(data: dict) -> dict:
+    """
+    Split a translated IR into the IRs of an arm-controller and a
+    base-controller process, which exchange the states of their robots over a
+    shared-memory link (gen/process_link.hpp) and run on a common cycle clock.
+
+    Every process controls the robots of its type and mirrors the others from
+    the states its peer publishes. It computes the entries the commands of its
+    own robots depend on, see robot_consumers; an entry feeding robots of both
+    processes is computed by both from the same states, an entry feeding no
+    robot by the arm controller. The base controller zeroes the commands of
+    the base while the arm states are stale, the arm controller holds the last
+    base state.
+
+    Returns the IR of each process, with the process section in `loop`.
+    """
+    d = data["d"]
+    loop = data["loop"]
+
+    link = loop["process_link"]
+    if not link.startswith("/") or "/" in link[1:] or len(link) < 2:
+        raise ValueError(f"process_link must be a shared-memory name like /name: {link}")
+
+    owners = {}
+    for robot, robot_data in d["robots"].items():
+        if robot_data["type"] not in ROBOT_PROCESSES:
+            raise ValueError(f"No process controls robots of type {robot_data['type']}")
+        owners[robot] = ROBOT_PROCESSES[robot_data["type"]]
+
+    if set(owners.values()) != set(PROCESS_LINK_SIDES):
+        raise ValueError("Split processes need both arms and a mobile base")
+
+    base_robots = [robot for robot, process in owners.items() if process == "base"]
+    if len(base_robots) != 1:
+        raise ValueError("Split processes support a single mobile base")
+
+    arms = [robot for robot, process in owners.items() if process == "arms"]
+    if len(arms) > MAX_LINK_ARMS:
+        raise ValueError(f"The process link supports at most {MAX_LINK_ARMS} arms")
+    slots = {robot: arms.index(robot) if robot in arms else 0 for robot in owners}
+
+    unknown = set(loop["process_rt"]) - set(PROCESS_LINK_SIDES)
+    if unknown:
+        raise ValueError(f"process_rt given for unknown processes: {sorted(unknown)}")
+
+    consumers = robot_consumers(d)
+
+    irs = {}
+    for process in PROCESS_LINK_SIDES:
+        own = {robot for robot, owner in owners.items() if owner == process}
+
+        ir = copy.deepcopy(data)
+        ir["rt"] = _process_rt(data["rt"], loop["process_rt"].get(process))
+        ir["loop"]["process"] = dict(
+            partition_entries(
+                d,
+                consumers,
+                lambda c, own=own, process=process: bool(c & own) or (not c and process == "arms"),
+            ),
+            name=process,
+            side=PROCESS_LINK_SIDES[process],
+            link=link,
+            stale_cycles=loop["stale_cycles"],
+            robots=[robot for robot in d["robots"] if robot in own],
+            own_robots={robot: {"slot": slots[robot]} for robot in d["robots"] if robot in own},
+            mirrored_robots={
+                robot: {"slot": slots[robot]} for robot in d["robots"] if robot not in own
+            },
+            zero_commands_on_stale=process == "base",
+        )
+        irs[process] = ir
+
+    arms_cpu = irs["arms"]["rt"]["control_cpu"] if irs["arms"]["rt"] else -1
+    base_cpu = irs["base"]["rt"]["control_cpu"] if irs["base"]["rt"] else -1
+    if arms_cpu >= 0 and arms_cpu == base_cpu:
+        raise ValueError("The arm and base controllers must not share their control cpu")
+
+    return irs
+
+
+def _process_rt(rt: dict, overrides: dict):
+    """
+    The real-time configuration of a process: the one of the spec with the
+    keys overridden for that process, e.g. its control and helper cpus.
+    """
+    if overrides is None:
+        return copy.deepcopy(rt)
+    return translate_rt_config(dict(rt or {}, **overrides))
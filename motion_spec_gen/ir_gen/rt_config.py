@@ -0,0 +1,51 @@
+import json
+
+SCHED_POLICIES = ["SCHED_FIFO", "SCHED_RR", "SCHED_OTHER"]
+
+# maximum number of helper cpus supported by RtConfig in gen/rt_setup.hpp
+MAX_HELPER_CPUS = 16
+
+DEFAULT_RT_CONFIG = {
+    "policy": "SCHED_FIFO",
+    "priority": 80,
+    "control_cpu": -1,
+    "helper_cpus": [],
+    "lock_memory": True,
+    "prefault_stack_size": 512 * 1024,
+    "prefault_heap_size": 64 * 1024 * 1024,
+}
+
+
+def translate_rt_config(config: dict) -> dict:
+    """
+    Validate the real-time configuration of the generated process and fill in
+    the defaults, so the templates can emit every field unconditionally.
+    """
+    rt = dict(DEFAULT_RT_CONFIG)
+
+    unknown = set(config) - set(rt)
+    if unknown:
+        raise ValueError(f"Unknown rt configuration keys: {sorted(unknown)}")
+
+    rt.update(config)
+
+    if rt["policy"] not in SCHED_POLICIES:
+        raise ValueError(f"Scheduling policy must be one of {SCHED_POLICIES}")
+
+    if rt["policy"] == "SCHED_OTHER":
+        rt["priority"] = 0
+    elif not 1 <= rt["priority"] <= 99:
+        raise ValueError("Real-time priority must be in [1, 99]")
+
+    if len(rt["helper_cpus"]) > MAX_HELPER_CPUS:
+        raise ValueError(f"At most {MAX_HELPER_CPUS} helper cpus are supported")
+
+    if rt["control_cpu"] >= 0 and rt["control_cpu"] in rt["helper_cpus"]:
+        raise ValueError("The control cpu must not be shared with the helper threads")
+
+    return rt
+
+
+def load_rt_config(file_path: str) -> dict:
+    with open(file_path, "r") as f:
+        return translate_rt_config(json.load(f))
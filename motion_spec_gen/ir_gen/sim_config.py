@@ -0,0 +1,105 @@
+import json
+
+# latency distributions supported by SimLatencyModel in gen/sim_kinova_mediator.hpp
+LATENCY_DISTRIBUTIONS = {
+    "constant": "SIM_LATENCY_CONSTANT",
+    "uniform": "SIM_LATENCY_UNIFORM",
+    "normal": "SIM_LATENCY_NORMAL",
+    "lognormal": "SIM_LATENCY_LOGNORMAL",
+}
+
+# joints of the simulated arms
+NUM_SIM_JOINTS = 7
+
+DEFAULT_SIM_CONFIG = {
+    "latency": None,
+    "joint_damping": 0.5,
+    "initial_positions": {},
+    "seed": 0,
+}
+
+DEFAULT_LATENCY_MODEL = {
+    "distribution": "normal",
+    "mean_us": 500.0,
+    "jitter_us": 50.0,
+    "spike_probability": 0.0,
+    "spike_us": 0.0,
+}
+
+
+def translate_sim_config(config: dict, data: dict) -> dict:
+    """
+    Validate the configuration of the simulated arms, which replace the Kinova
+    mediators of the generated code, and fill in the defaults. The mobile bases
+    are tagged with `sim`, they are replaced by a simulated platform
+    (gen/sim_kelo_base.hpp) as the EtherCAT segment is not connected either.
+
+    Every request to a simulated arm blocks for a round trip sampled from the
+    `latency` model. `initial_positions` maps manipulators to the joint
+    positions they start in, the others start in the zero pose.
+    """
+    sim = dict(DEFAULT_SIM_CONFIG)
+
+    unknown = set(config) - set(sim)
+    if unknown:
+        raise ValueError(f"Unknown sim configuration keys: {sorted(unknown)}")
+
+    sim.update(config)
+
+    sim["latency"] = _translate_latency_model(sim["latency"] or {})
+
+    if sim["joint_damping"] < 0:
+        raise ValueError("Joint damping of the simulated arms must not be negative")
+
+    if not isinstance(sim["seed"], int) or sim["seed"] < 0:
+        raise ValueError("Seed of the latency model must be a non-negative integer")
+
+    manipulators = [
+        id for id, robot in data["d"]["robots"].items() if robot["type"] == "Manipulator"
+    ]
+
+    for id, positions in sim["initial_positions"].items():
+        if id not in manipulators:
+            raise ValueError(f"Initial positions given for unknown manipulator: {id}")
+        if len(positions) != NUM_SIM_JOINTS:
+            raise ValueError(f"Initial positions of {id} need {NUM_SIM_JOINTS} values")
+
+    sim["initial_positions"] = {
+        id: sim["initial_positions"].get(id, [0.0] * NUM_SIM_JOINTS) for id in manipulators
+    }
+
+    for robot in data["d"]["robots"].values():
+        if robot["type"] == "MobileBase":
+            robot["sim"] = True
+
+    return sim
+
+
+def _translate_latency_model(config: dict) -> dict:
+    latency = dict(DEFAULT_LATENCY_MODEL)
+
+    unknown = set(config) - set(latency)
+    if unknown:
+        raise ValueError(f"Unknown sim latency keys: {sorted(unknown)}")
+
+    latency.update(config)
+
+    if latency["distribution"] not in LATENCY_DISTRIBUTIONS:
+        raise ValueError(
+            f"Latency distribution must be one of {sorted(LATENCY_DISTRIBUTIONS)}"
+        )
+    if latency["mean_us"] < 0 or latency["jitter_us"] < 0 or latency["spike_us"] < 0:
+        raise ValueError("Latency times must not be negative")
+    if latency["distribution"] == "lognormal" and latency["mean_us"] == 0:
+        raise ValueError("A lognormal latency needs a positive mean")
+    if not 0 <= latency["spike_probability"] <= 1:
+        raise ValueError("Latency spike probability must be in [0, 1]")
+
+    latency["distribution_id"] = LATENCY_DISTRIBUTIONS[latency["distribution"]]
+
+    return latency
+
+
+def load_sim_config(file_path: str, data: dict) -> dict:
+    with open(file_path, "r") as f:
+        return translate_sim_config(json.load(f), data)
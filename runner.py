@@ -30,9 +30,19 @@ from motion_spec_gen.ir_gen.translators import (
     RobotsTranslator,
     CoordinatesTranslator
 )
+from motion_spec_gen.ir_gen.rt_config import load_rt_config
+from motion_spec_gen.ir_gen.loop_config import load_loop_config, translate_loop_config
+from motion_spec_gen.ir_gen.sim_config import load_sim_config
+from motion_spec_gen.ir_gen.process_split import split_processes
+from motion_spec_gen.ir_gen.cycle_budget import (
+    load_primitive_costs,
+    estimate_cycle_budget,
+    print_cycle_budget,
+    check_cycle_budget,
+)
 
 
-def main(motion_spec_name: str = None, ir_out_file_name: str = "ir.json", verbose: bool = False, print_graph: bool = False):
+def main(motion_spec_name: str = None, ir_out_file_name: str = "ir.json", verbose: bool = False, print_graph: bool = False, rt_config_file: str = None, loop_config_file: str = None, primitive_costs_file: str = None, sim_config_file: str = None):
 
     if motion_spec_name is None:
         raise ValueError("Motion specification name is required")
@@ -88,8 +98,14 @@ def main(motion_spec_name: str = None, ir_out_file_name: str = "ir.json", verbos
             "solvers": {},
             "robots": {},
         },
+        "rt": None,
+        "loop": None,
+        "sim": None,
     }
 
+    if rt_config_file is not None:
+        data["rt"] = load_rt_config(rt_config_file)
+
     for motion_spec in g.subjects(rdflib.RDF.type, MOTION_SPEC.MotionSpec):
 
         if verbose:
@@ -214,22 +230,51 @@ def main(motion_spec_name: str = None, ir_out_file_name: str = "ir.json", verbos
 
     # print("--" * 20)
 
-    json_obj = json.dumps(data, indent=2)
+    # loop frequency and rate divisors, applied to the translated entries
+    if loop_config_file is not None:
+        data["loop"] = load_loop_config(loop_config_file, data)
+    else:
+        data["loop"] = translate_loop_config({}, data)
+
+    # simulated arms instead of the Kinova mediators
+    if sim_config_file is not None:
+        data["sim"] = load_sim_config(sim_config_file, data)
+
+    # arm and base controllers as cooperating processes, one IR each
+    if data["loop"]["split_processes"]:
+        irs = {f"_{process}": ir for process, ir in split_processes(data).items()}
+    else:
+        irs = {"": data}
+
+    if ir_out_file_name.endswith(".json"):
+        ir_out_file_name = ir_out_file_name[: -len(".json")]
+
+    for suffix, ir in irs.items():
+        # fail early if the spec can not run at the loop frequency
+        cycle_budget = estimate_cycle_budget(ir, load_primitive_costs(primitive_costs_file))
+        if verbose:
+            if suffix:
+                print(f"{suffix[1:]} process:")
+            print_cycle_budget(cycle_budget, primitive_costs_file is not None)
+        check_cycle_budget(cycle_budget)
+
+    for suffix, ir in irs.items():
+        json_obj = json.dumps(ir, indent=2)
 
-    # print(json_obj)
+        # print(json_obj)
 
-    # write to file
-    if not ir_out_file_name.endswith(".json"):
-        ir_out_file_name += ".json"
-    file_path = os.path.join(os.path.dirname(__file__), "irs", ir_out_file_name)
-    with open(file_path, "w") as f:
-        f.write(json_obj)
+        # write to file
+        file_path = os.path.join(
+            os.path.dirname(__file__), "irs", ir_out_file_name + suffix + ".json"
+        )
+        with open(file_path, "w") as f:
+            f.write(json_obj)
 
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(
         description="Generate motion specification IR",
-        usage="python -m motion_spec_gen.runner -m <motion_spec_name> -o <output_file_name> [-v] [-g]",
+        usage="python -m motion_spec_gen.runner -m <motion_spec_name> -o <output_file_name> [-r <rt_config_file>] [-l <loop_config_file>] [-c <primitive_costs_file>] [-s <sim_config_file>] [-v] [-g]",
     )
     # define arguments
     parser.add_argument(
@@ -238,6 +283,18 @@ if __name__ == "__main__":
     parser.add_argument(
         "-m", "--motion-spec", type=str, help="Motion specification name"
     )
+    parser.add_argument(
+        "-r", "--rt", type=str, help="Real-time configuration (json) of the generated process", default=None
+    )
+    parser.add_argument(
+        "-l", "--loop", type=str, help="Control loop configuration (json): frequency and rate divisors", default=None
+    )
+    parser.add_argument(
+        "-c", "--costs", type=str, help="Calibrated primitive costs (json) for the cycle budget estimate", default=None
+    )
+    parser.add_argument(
+        "-s", "--sim", type=str, help="Simulated arms configuration (json): latency model and initial poses", default=None
+    )
     parser.add_argument(
         "-v", "--verbose", action="store_true", help="Print verbose output"
     )
@@ -247,4 +304,4 @@ if __name__ == "__main__":
 
     args = parser.parse_args()
 
-    main(args.motion_spec, args.output, args.verbose, args.graph)
\ No newline at end of file
+    main(args.motion_spec, args.output, args.verbose, args.graph, args.rt, args.loop, args.costs, args.sim)
\ No newline at end of file